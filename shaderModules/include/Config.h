@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Runtime knobs are read from environment variables (VULK_*) so a build can be tuned
+// or benchmarked without recompiling. Unset or malformed values fall back to the default.
+
+inline uint32_t envUint(const char* name, uint32_t fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || parsed > UINT32_MAX) {
+        return fallback;
+    }
+    return static_cast<uint32_t>(parsed);
+}
+
+inline bool envFlag(const char* name, bool fallback = false) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    return strcmp(value, "1") == 0 || strcmp(value, "true") == 0 || strcmp(value, "on") == 0 || strcmp(value, "yes") == 0;
+}
+
+inline std::string envString(const char* name, const std::string& fallback = "") {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    return value;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+
+// Features promoted to core in Vulkan 1.1 - 1.3 that code paths can ask for
+enum class CoreFeature : uint32_t {
+    TimelineSemaphore,
+    Synchronization2,
+    DynamicRendering,
+    DescriptorIndexing, // runtime arrays, partially bound and variable count bindings, non-uniform sampled image indexing
+    BufferDeviceAddress,
+    StorageBuffer8Bit,
+    StorageBuffer16Bit,
+    Maintenance4,
+    PipelineCreationCacheControl,
+    Count
+};
+
+/*
+Negotiates the core features of the logical device through VkPhysicalDeviceVulkan11/12/13Features.
+# Callers declare what they need before the device is created: require() makes device creation fail without it,
+  request() enables it only where supported. VULK_DEVICE_FEATURES=name,name requests more by name (see name()).
+# negotiate() queries the structs the device's apiVersion has (11 and 12 from 1.2, 13 from 1.3), a feature of a newer
+  version counts as unsupported. chain() then links only the structs with something enabled into the create info.
+# enabled() is what the device was actually created with, so the faster path can be picked at runtime.
+# The Vulkan1x structs may not be chained together with the older per-feature structs they replace
+  (VkPhysicalDeviceTimelineSemaphoreFeatures and the like), a promoted feature is enabled through here only.
+*/
+class CoreFeatureNegotiator {
+public:
+    void require(CoreFeature feature);
+    void request(CoreFeature feature);
+    // Reads VULK_DEVICE_FEATURES, unknown names are reported and skipped
+    void requestFromEnvironment();
+
+    // Throws when a required feature is missing
+    void negotiate(VkPhysicalDevice device, uint32_t apiVersion);
+    // Links the enable structs in front of next and returns the new head of the chain
+    void* chain(void* next);
+
+    bool supported(CoreFeature feature) const { return (supportedMask & bit(feature)) != 0; }
+    bool enabled(CoreFeature feature) const { return (enabledMask & bit(feature)) != 0; }
+
+    void print() const;
+
+    static const char* name(CoreFeature feature);
+
+private:
+    static uint32_t bit(CoreFeature feature) { return 1u << static_cast<uint32_t>(feature); }
+
+    uint32_t requiredMask = 0;
+    uint32_t requestedMask = 0;
+    uint32_t supportedMask = 0;
+    uint32_t enabledMask = 0;
+
+    // What gets enabled, only the bits of enabled features are set
+    VkPhysicalDeviceVulkan11Features vulkan11{};
+    VkPhysicalDeviceVulkan12Features vulkan12{};
+    VkPhysicalDeviceVulkan13Features vulkan13{};
+};
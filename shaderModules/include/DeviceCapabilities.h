@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+/*
+Everything we ask a physical device about, queried once and then only read.
+# Device selection, queue family lookup, logical device creation, swap chain creation, the pipeline cache,
+  the GPU profiler and the offscreen target all read this snapshot instead of repeating
+  vkGetPhysicalDevice* / vkEnumerateDeviceExtensionProperties calls.
+# extensions is sorted, hasExtension() is a binary search.
+# The device part (features, memory, queue families, extensions) is saved to disk, one file per deviceUUID, and reused
+  on the next start when vendorID, deviceID, driverVersion, apiVersion and pipelineCacheUUID still match,
+  so a driver update invalidates it. The properties and deviceUUID are always queried, they are the key.
+# The surface part (present support, formats, present modes) belongs to a surface of this run and is never cached.
+  Surface capabilities aren't part of it at all: currentExtent follows the window size, so the swap chain re-queries them.
+*/
+struct DeviceCapabilities {
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceFeatures features{};
+    VkPhysicalDeviceMemoryProperties memory{};
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    std::vector<std::string> extensions; // sorted
+    uint8_t deviceUUID[VK_UUID_SIZE] = {}; // all zero on 1.0 devices
+
+    std::vector<VkBool32> presentSupport; // per queue family, empty without a surface
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    bool fromDisk = false; // the device part came from the snapshot file
+
+    bool hasExtension(const char* name) const;
+};
+
+// cacheDirectory empty: VULK_DEVICE_CACHE_DIR, or the working directory. VULK_DEVICE_CACHE=0 always enumerates.
+// surface may be VK_NULL_HANDLE (headless), the surface part stays empty then
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice device, VkSurfaceKHR surface, const std::string& cacheDirectory = "");
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What device ranking looks at, gathered once per physical device
+struct PhysicalDeviceCandidate {
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    uint32_t index = 0; // position in vkEnumeratePhysicalDevices
+    std::string name;
+    std::string uuid; // deviceUUID as hex, stable across runs and driver updates of the same GPU
+    VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+    uint64_t deviceLocalBytes = 0; // largest DEVICE_LOCAL heap
+    bool dedicatedTransferQueue = false; // a family with TRANSFER but neither GRAPHICS nor COMPUTE
+    bool dedicatedComputeQueue = false; // a family with COMPUTE but no GRAPHICS
+    std::vector<std::string> perfExtensions; // supported entries of the lists in DeviceSelection.cpp, promoted ones also by core version
+    uint32_t maxImageDimension2D = 0;
+    uint32_t maxComputeWorkGroupInvocations = 0;
+
+    bool suitable = false; // set by the caller, it knows what the renderer requires
+    int64_t score = 0;
+};
+
+/*
+Picks the physical device to render on, instead of taking the first suitable one.
+# The score is dominated by the device type (discrete > integrated > virtual > CPU), so a software rasterizer
+  or the integrated GPU of a hybrid laptop never wins against a discrete GPU because of enumeration order.
+# Within a type, the size of the largest device-local heap counts most, then dedicated transfer/compute queues,
+  extensions that have a fast path in this renderer, and a few limits as tie breakers.
+# VULK_DEVICE overrides the ranking: an index into the enumeration order or a deviceUUID in hex (dashes allowed).
+*/
+PhysicalDeviceCandidate describePhysicalDevice(const DeviceCapabilities& capabilities, uint32_t index);
+int64_t scorePhysicalDevice(const PhysicalDeviceCandidate& candidate);
+
+// Sorts suitable devices first, then by score, highest first
+void rankPhysicalDevices(std::vector<PhysicalDeviceCandidate>& candidates);
+
+// The candidate selector names, or nullptr when selector is empty. Throws when nothing matches
+const PhysicalDeviceCandidate* findRequestedDevice(const std::vector<PhysicalDeviceCandidate>& candidates, const std::string& selector);
+
+void printDeviceRanking(const std::vector<PhysicalDeviceCandidate>& candidates, const PhysicalDeviceCandidate& chosen);
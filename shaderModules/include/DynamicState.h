@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Fixed-function state that would otherwise be baked into every pipeline, and so multiply the pipeline count
+struct RasterState {
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    bool primitiveRestart = false;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    bool depthTest = false;
+    bool depthWrite = false;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+    bool operator==(const RasterState& other) const;
+    std::string toString() const;
+};
+
+// Groups of RasterState that can be dynamic, each tied to the extension that makes it dynamic
+enum DynamicRasterBits : uint32_t {
+    DYNAMIC_RASTER_TOPOLOGY = 1 << 0, // primitive topology (extended_dynamic_state)
+    DYNAMIC_RASTER_CULL_MODE = 1 << 1, // cull mode (extended_dynamic_state)
+    DYNAMIC_RASTER_FRONT_FACE = 1 << 2, // front face (extended_dynamic_state)
+    DYNAMIC_RASTER_DEPTH = 1 << 3, // depth test/write enable and compare op (extended_dynamic_state)
+    DYNAMIC_RASTER_PRIMITIVE_RESTART = 1 << 4, // primitive restart enable (extended_dynamic_state2)
+    DYNAMIC_RASTER_POLYGON_MODE = 1 << 5 // polygon mode (extended_dynamic_state3)
+};
+
+// The bits VK_EXT_extended_dynamic_state, 2 and 3 (or core 1.3 for the first two) make available
+uint32_t dynamicRasterBitsFor(bool extendedDynamicState, bool extendedDynamicState2, bool polygonMode);
+
+// The VkDynamicState values for the dynamic groups in mask
+std::vector<VkDynamicState> dynamicStatesFor(uint32_t mask);
+
+// state with every dynamic group reset to its default. Pipelines are built from this, so all states that
+// only differ in dynamic groups map onto one pipeline
+RasterState canonicalRasterState(const RasterState& state, uint32_t mask);
+
+/*
+Extended dynamic state mode.
+# Opt in with VULK_DYNAMIC_STATE=1. Whatever the device supports of RasterState becomes dynamic state: pipelines are built
+  with defaults for it and the real values are recorded per draw, so cull mode, topology or depth test changes reuse the same pipeline.
+# Groups the device can't make dynamic stay baked into the pipeline, exactly like without this mode.
+# The vkCmdSet* entry points are loaded through vkGetDeviceProcAddr, under their core 1.3 names or the EXT aliases.
+*/
+class DynamicRasterState {
+public:
+    void init(VkDevice device, uint32_t supportedMask);
+
+    uint32_t mask() const { return dynamicMask; }
+
+    // Records the dynamic groups of state. Call after binding a pipeline built with dynamicStatesFor(mask())
+    void record(VkCommandBuffer commandBuffer, const RasterState& state) const;
+
+private:
+    uint32_t dynamicMask = 0;
+
+    PFN_vkCmdSetPrimitiveTopology setPrimitiveTopology = nullptr;
+    PFN_vkCmdSetCullMode setCullMode = nullptr;
+    PFN_vkCmdSetFrontFace setFrontFace = nullptr;
+    PFN_vkCmdSetDepthTestEnable setDepthTestEnable = nullptr;
+    PFN_vkCmdSetDepthWriteEnable setDepthWriteEnable = nullptr;
+    PFN_vkCmdSetDepthCompareOp setDepthCompareOp = nullptr;
+    PFN_vkCmdSetPrimitiveRestartEnable setPrimitiveRestartEnable = nullptr;
+    PFN_vkCmdSetPolygonModeEXT setPolygonMode = nullptr;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+
+class QueueTimeline;
+
+/*
+Low-latency frame pacing (VULK_FRAME_PACING=1). Input is sampled and commands are recorded as late as possible,
+so what is on screen is as fresh as possible instead of sitting behind frames already queued for presentation.
+# With VK_KHR_present_id and VK_KHR_present_wait every present gets an id. beginFrame() waits until the frame
+  VULK_PACING_DEPTH presents back (default 1, the previous one) is on screen, then sleeps before input is sampled.
+# The present time is approximated by when vkWaitForPresentKHR returns, so wakeup latency of this thread is part of it.
+  Only waits that actually blocked count. A wait that returns right away means the frame was on screen at some unknown
+  earlier time, feeding that in would look like a missed vblank and cut the sleep for nothing.
+# The sleep is tuned from those present times: each frame predicts the vblank it should land on. While frames
+  arrive on time the sleep grows in small steps, a frame that misses its vblank cuts it back and lowers the ceiling
+  it may grow to. The ceiling creeps back up slowly, so a one-off slow frame doesn't cost latency for long.
+# Without those extensions it falls back to fences: beginFrame() waits for the GPU to finish the previous frame
+  (its fence, or its graphics timeline value), which keeps at most one frame of GPU work queued but can't see the
+  presentation engine, so there is no sleep.
+# Latency from input sampling to present (or to GPU completion with fences) and the prediction error are recorded
+  as profiler counters and summarized by report().
+*/
+class FramePacer {
+public:
+    // presentWait: the device was created with presentId and presentWait enabled
+    void init(VkDevice device, bool presentWait, uint32_t queueDepth);
+    void setRefreshRate(double hz);
+
+    bool enabled() const { return device != VK_NULL_HANDLE; }
+    bool usesPresentWait() const { return waitForPresent != nullptr; }
+
+    // Right before input is sampled. Without present wait it waits for the last submitted frame: for previousFrameValue
+    // on timeline when there is one, otherwise for previousFrameFence
+    void beginFrame(VkSwapchainKHR swapChain, VkFence previousFrameFence, QueueTimeline* timeline = nullptr, uint64_t previousFrameValue = 0);
+
+    // Chained into VkPresentInfoKHR::pNext. Assigns the frame its present id, nullptr without present wait.
+    // The pointer stays valid until the next call
+    const void* presentId(VkSwapchainKHR swapChain);
+
+    void report() const;
+
+private:
+    struct PendingFrame {
+        uint64_t presentId;
+        uint64_t inputNs; // when beginFrame returned
+        uint64_t predictedNs; // the vblank it should be presented at, 0 when unknown
+    };
+
+    void framePresented(const PendingFrame& frame, uint64_t presentedNs);
+
+    VkDevice device = VK_NULL_HANDLE;
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+    uint32_t depth = 1;
+
+    VkSwapchainKHR currentSwapChain = VK_NULL_HANDLE; // present ids belong to one swap chain
+    std::deque<PendingFrame> pending; // presented, not yet seen on screen
+    uint64_t nextPresentId = 1;
+    VkPresentIdKHR presentIdInfo{};
+    uint64_t presentIdValue = 0;
+
+    uint64_t refreshNs = 0; // from the monitor, or learned from present intervals when unknown
+    bool refreshFromMonitor = false;
+    uint64_t lastPresentedNs = 0;
+    uint64_t frameInputNs = 0; // input time of the frame being recorded
+    uint64_t frameSubmittedInputNs = 0; // fence mode: input time of the frame the fence belongs to
+
+    // Sleep before input sampling and the ceiling it may grow to
+    double sleepNs = 0.0;
+    double ceilingNs = 0.0;
+
+    uint64_t frames = 0;
+    uint64_t missed = 0;
+    uint64_t unobserved = 0; // presents whose wait didn't block, left out of the latency and the controller
+    double latencySumMs = 0.0;
+    double latencyMaxMs = 0.0;
+    double errorSumMs = 0.0; // absolute prediction error
+    uint64_t predicted = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DynamicState.h"
+#include "PipelineVariants.h"
+#include "ShaderModuleCache.h"
+#include "SpirvReflect.h"
+
+#include <string>
+#include <vector>
+
+struct PipelineShaderStage {
+    ShaderModuleRef module; // shared, also keeps the module alive while the build is queued
+    const ShaderReflection* reflection = nullptr; // must outlive the build, the entry point and stage come from here
+    uint32_t entryPointIndex = 0;
+};
+
+/*
+Self-contained description of one graphics pipeline.
+# It is a plain value with no references into the application other than Vulkan handles and the stage reflections,
+  so it can be handed to a worker thread and built there (see PipelineBuildService).
+# Viewport and scissor are always dynamic, so a pipeline never has to be rebuilt because the extent changed.
+# The groups of raster state in dynamicRaster (DynamicRasterBits) are dynamic too, their values in raster are ignored.
+*/
+struct GraphicsPipelineDesc {
+    std::string name; // for logging only
+
+    std::vector<PipelineShaderStage> stages;
+    SpecializationKey specialization;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    RasterState raster;
+    uint32_t dynamicRaster = 0;
+
+    // What the pipeline is built for (e.g. its shader program), PipelineLibrary releases the parts an owner used with it
+    const void* owner = nullptr;
+};
+
+/*
+Creates the pipeline through the given cache (VK_NULL_HANDLE for none). Throws std::runtime_error on failure.
+# Safe to call from several threads at once: VkPipelineCache is internally synchronized.
+# Stages whose module hasn't been created yet but has an identifier are first tried by identifier only.
+  On a pipeline cache miss the driver answers VK_PIPELINE_COMPILE_REQUIRED and the build is retried with real modules.
+*/
+VkPipeline buildGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc);
+
+/*
+VK_EXT_graphics_pipeline_library: a pipeline split into independently compiled parts.
+# part is one VkGraphicsPipelineLibraryFlagBitsEXT (vertex input, pre-rasterization shaders, fragment shader or fragment output),
+  only the state that part owns is taken from desc.
+# linkGraphicsPipeline combines one library per part into a complete pipeline. Without optimize this is a cheap link
+  of the precompiled code, with it the driver reoptimizes across the parts (the link time optimization info is retained in every part).
+*/
+VkPipeline buildGraphicsPipelineLibrary(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc,
+                                        VkGraphicsPipelineLibraryFlagsEXT part);
+VkPipeline linkGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const std::vector<VkPipeline>& libraries,
+                                VkPipelineLayout layout, bool optimize, const std::string& name);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Offscreen render target for headless runs (VULK_HEADLESS=1), standing in for the swap chain.
+# A ring of color images in device-local memory, each with a view, that can be rendered to and copied from.
+  Nothing is presented, the render pass leaves the image in TRANSFER_SRC_OPTIMAL instead of PRESENT_SRC_KHR.
+# readback() copies one image into a host-visible buffer and writes it out as a binary PPM, e.g. for golden-image tests.
+# Needs no surface, window or display, so it runs on build machines through a software driver like lavapipe.
+*/
+class OffscreenTarget {
+public:
+    void create(const DeviceCapabilities& capabilities, VkDevice device, VkFormat format, VkExtent2D extent, uint32_t imageCount);
+    void destroy();
+
+    const std::vector<VkImage>& images() const { return colorImages; }
+    const std::vector<VkImageView>& imageViews() const { return colorViews; }
+
+    // Blocks until the copy has finished. The image must be idle and in TRANSFER_SRC_OPTIMAL
+    void readback(VkCommandPool commandPool, VkQueue queue, uint32_t imageIndex, const std::string& path) const;
+
+private:
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDevice device = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+
+    std::vector<VkImage> colorImages;
+    std::vector<VkDeviceMemory> colorMemory;
+    std::vector<VkImageView> colorViews;
+};
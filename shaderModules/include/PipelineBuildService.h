@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "GraphicsPipeline.h"
+#include "PipelineLibrary.h"
+#include "ShaderObjects.h"
+#include "ThreadPool.h"
+
+#include <future>
+#include <vector>
+
+/*
+Compiles graphics pipelines on a pool of worker threads.
+# Every worker goes through the same VkPipelineCache, which the driver synchronizes internally,
+  so whatever one worker compiles is a cache hit for the others and ends up in the saved blob.
+# submit() returns immediately with a shared future, so the caller can wait for exactly the pipelines
+  it needs right now (e.g. the first frame's) while the rest keep compiling in the background.
+# With a PipelineLibrary a build can also be a fast or an optimized link of graphics pipeline library parts.
+# submitShaderObjects() compiles the VkShaderEXTs of a desc on the same workers, for the shader object backend.
+*/
+enum class PipelineLinkMode {
+    Monolithic, // one vkCreateGraphicsPipelines with the complete state
+    FastLink, // precompiled library parts linked without optimization
+    OptimizedLink // library parts linked with link time optimization
+};
+
+class PipelineBuildService {
+public:
+    // workerCount 0 means one worker per hardware thread. library is needed for the link modes
+    void start(VkDevice device, VkPipelineCache pipelineCache, uint32_t workerCount = 0, PipelineLibrary* library = nullptr);
+    void stop(); // finishes the queued builds, then joins the workers
+
+    std::shared_future<VkPipeline> submit(GraphicsPipelineDesc desc, PipelineLinkMode mode = PipelineLinkMode::Monolithic);
+    std::vector<std::shared_future<VkPipeline>> submitBatch(std::vector<GraphicsPipelineDesc> descs);
+    // backend.get(desc) on a worker. The backend has to outlive the build
+    std::shared_future<ShaderObjectSet> submitShaderObjects(GraphicsPipelineDesc desc, ShaderObjectBackend& backend);
+
+    uint32_t workerCount() const { return workers.size(); }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    PipelineLibrary* library = nullptr;
+    ThreadPool workers;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.h"
+
+#include <string>
+#include <vector>
+
+/*
+Persistent VkPipelineCache.
+# The cache blob is loaded from disk when the cache is created and written back by save(), so a warm start
+  can skip most of the driver's shader compilation inside vkCreateGraphicsPipelines.
+# The blob header stores the vendorID, deviceID and pipelineCacheUUID of the device that produced it.
+  A blob from another GPU or another driver version is useless (or worse, rejected by the driver),
+  so it is validated against the picked physical device and thrown away when stale.
+# Blobs are stored per pipelineCacheUUID, so switching between GPUs does not keep overwriting the same file.
+*/
+class PipelineCache {
+public:
+    // load() reads and validates the blob and needs no VkDevice, so startup can run it while the logical device
+    // is still being created. create() then hands the blob to the driver.
+    // directory defaults to VULK_PIPELINE_CACHE_DIR, or the working directory when that is unset
+    void load(const DeviceCapabilities& capabilities, const std::string& directory = "");
+    void create(VkDevice device);
+    void save() const;
+    void destroy();
+
+    VkPipelineCache get() const { return cache; }
+    bool loadedFromDisk() const { return warm; }
+
+private:
+    bool isCompatible(const std::vector<char>& blob) const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    std::string path;
+    std::vector<char> initialData; // the loaded blob, dropped once the cache is created
+    bool warm = false;
+};
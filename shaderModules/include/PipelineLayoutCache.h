@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "SpirvReflect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+Deduplicating owner of descriptor set layouts and pipeline layouts.
+# Layouts are looked up by their contents, so pipelines whose shaders declare the same resources
+  share one VkDescriptorSetLayout / VkPipelineLayout instead of each creating a duplicate.
+# The cache owns every layout it hands out, they are destroyed together in destroy().
+# Lookups are guarded by a mutex so pipelines can be built from several threads.
+*/
+class PipelineLayoutCache {
+public:
+    void init(VkDevice device);
+    void destroy();
+
+    VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+    VkPipelineLayout getPipelineLayout(const PipelineLayoutDesc& desc);
+
+    size_t setLayoutCount() const { return setLayouts.size(); }
+    size_t pipelineLayoutCount() const { return pipelineLayouts.size(); }
+
+private:
+    struct KeyHash {
+        size_t operator()(const std::vector<uint32_t>& key) const;
+    };
+
+    VkDescriptorSetLayout getSetLayoutLocked(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::mutex mutex;
+    std::unordered_map<std::vector<uint32_t>, VkDescriptorSetLayout, KeyHash> setLayouts;
+    std::unordered_map<std::vector<uint32_t>, VkPipelineLayout, KeyHash> pipelineLayouts;
+};
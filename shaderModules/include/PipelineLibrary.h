@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "GraphicsPipeline.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+Cache of VK_EXT_graphics_pipeline_library parts.
+# A pipeline is split into its four parts (vertex input, pre-rasterization, fragment shader, fragment output),
+  each compiled once and looked up by the state it depends on. A new material combination that reuses a
+  vertex shader or an output setup only compiles the parts it doesn't share with earlier pipelines.
+# fastLink() gets the pipeline on screen with a cheap link of the parts. optimizedLink() produces the
+  pipeline a monolithic build would, it is meant to run in the background and replace the fast one.
+# Parts are compiled at most once even when several workers ask for the same one at the same time.
+# The cache owns the parts. Each part remembers the owners (GraphicsPipelineDesc::owner) it was linked for, release()
+  hands back the parts no other owner uses anymore so they can be retired along with the owner. destroy() takes the rest.
+  Linked pipelines belong to the caller.
+*/
+class PipelineLibrary {
+public:
+    void init(VkDevice device, VkPipelineCache pipelineCache);
+    void destroy();
+
+    VkPipeline fastLink(const GraphicsPipelineDesc& desc);
+    VkPipeline optimizedLink(const GraphicsPipelineDesc& desc);
+
+    // Drops owner from every part and returns the parts left without an owner, for the caller to destroy once the GPU
+    // is done with what was linked from them. Call it when the owner's builds have finished
+    std::vector<VkPipeline> release(const void* owner);
+
+    size_t partCount() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const std::vector<uint32_t>& key) const;
+    };
+
+    struct Part {
+        std::shared_future<VkPipeline> pipeline;
+        std::vector<const void*> owners;
+    };
+
+    VkPipeline link(const GraphicsPipelineDesc& desc, bool optimize);
+    VkPipeline getPart(const GraphicsPipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT part);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::vector<uint32_t>, Part, KeyHash> parts;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DynamicState.h"
+#include "SpirvReflect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+Specialization-constant pipeline variants.
+# A variant is identified by a compact key of (constant_id, value) pairs. A value is a bool, an integer (kept as int64)
+  or a float (kept as double). It is converted to the type and width the shader declares when the pipeline is built,
+  a value of the wrong kind or out of range for that width is an error rather than reinterpreted bits.
+# Specialization constants are folded by the driver when the pipeline is compiled, so a loop count or a
+  feature toggle costs nothing at draw time and no extra .spv per variant is needed.
+# Constants the key doesn't mention keep the default declared in the shader.
+*/
+struct SpecializationValue {
+    enum class Type { Bool, Integer, Float };
+
+    Type type = Type::Integer;
+    uint64_t bits = 0; // 0/1, the int64 two's complement or the double's IEEE bits
+
+    int64_t integer() const { return static_cast<int64_t>(bits); }
+    double floating() const;
+    std::string toString() const;
+
+    bool operator==(const SpecializationValue& other) const { return type == other.type && bits == other.bits; }
+};
+
+struct SpecializationKey {
+    std::vector<std::pair<uint32_t, SpecializationValue>> values; // sorted by constant_id, unique
+
+    SpecializationKey& set(uint32_t constantId, SpecializationValue value);
+    SpecializationKey& setBool(uint32_t constantId, bool value);
+    SpecializationKey& setInt(uint32_t constantId, int64_t value);
+    SpecializationKey& setFloat(uint32_t constantId, double value);
+
+    const SpecializationValue* find(uint32_t constantId) const;
+
+    // "id=value,id=value", values may be integers (decimal or 0x hex), floats (with a '.' or an exponent) or true/false.
+    // Throws on malformed input
+    static SpecializationKey parse(const std::string& text);
+    std::string toString() const;
+
+    bool operator==(const SpecializationKey& other) const { return values == other.values; }
+
+    struct Hash {
+        size_t operator()(const SpecializationKey& key) const;
+    };
+};
+
+// Everything a variant is built from: the specialization constants plus the raster state that isn't dynamic.
+// Callers pass canonicalRasterState(...), so states that only differ in dynamic groups share one variant
+struct PipelineVariantKey {
+    SpecializationKey specialization;
+    RasterState raster;
+
+    std::string toString() const;
+
+    bool operator==(const PipelineVariantKey& other) const { return specialization == other.specialization && raster == other.raster; }
+
+    struct Hash {
+        size_t operator()(const PipelineVariantKey& key) const;
+    };
+};
+
+// VkSpecializationInfo for one stage plus the storage it points into
+struct SpecializationData {
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+    VkSpecializationInfo info{};
+
+    // nullptr when the stage has nothing to specialize. The pointer is only valid while this object is alive and unmoved
+    const VkSpecializationInfo* get();
+};
+
+// Picks the key values for the constants this stage declares, converted to the type and width the stage declares.
+// Throws std::runtime_error when a value doesn't fit its constant (a float for an int, a negative uint, out of range, ...)
+SpecializationData buildSpecializationData(const ShaderReflection& stage, const SpecializationKey& key);
+
+/*
+Variant cache: starts building a pipeline the first time a key is requested and returns the same pipeline afterwards.
+# The build function only has to hand back a future, so builds can run on worker threads (see PipelineBuildService).
+  request() queues a build without waiting for it, get() waits for the one pipeline it needs.
+# A build that failed is dropped by the next request() for its key, which starts a new one, so a key can be retried.
+# The cache owns the pipelines and destroys them in destroy(), which waits for builds still in progress.
+*/
+class PipelineVariantCache {
+public:
+    using BuildFunction = std::function<std::shared_future<VkPipeline>(const PipelineVariantKey&)>;
+
+    void init(VkDevice device, BuildFunction build);
+    void destroy();
+
+    VkPipeline get(const PipelineVariantKey& key); // blocks until the variant is built, rethrows build errors
+    std::shared_future<VkPipeline> request(const PipelineVariantKey& key); // never blocks
+
+    // Swaps a finished variant for a better build of the same state (e.g. an optimized link), returns the previous
+    // pipeline. The caller owns it from then on and destroys it once no frame in flight uses it
+    VkPipeline replace(const PipelineVariantKey& key, VkPipeline pipeline);
+    size_t size() const;
+    bool idle() const; // true when no build is still running, so destroy() would not block
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    BuildFunction build;
+    mutable std::mutex mutex;
+    std::unordered_map<PipelineVariantKey, std::shared_future<VkPipeline>, PipelineVariantKey::Hash> variants;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Which present mode the swap chain uses and how many images it gets, picked at runtime (VULK_PRESENT_MODE).
+# immediate, mailbox, fifo, fifo_relaxed: that mode, or FIFO (always supported) when the surface doesn't offer it.
+  Unset is "mailbox", which falls back to FIFO like the tutorial did.
+# adaptive: starts with FIFO. When too many frames miss a vblank it switches to FIFO_RELAXED (late frames tear instead
+  of waiting a whole refresh), or IMMEDIATE without it. Once frames are back within the refresh interval it returns to FIFO.
+  Misses are estimated from the time between presents against the monitor refresh rate, there's no present timing API here.
+# The image count follows the mode: IMMEDIATE keeps the minimum for the lowest latency, FIFO adds one so the CPU
+  can record while an image is queued, MAILBOX wants at least three so the newest frame can always replace a queued one.
+  VULK_SWAPCHAIN_IMAGES=N overrides it.
+*/
+class PresentModePolicy {
+public:
+    // Unknown names are treated like unset, with a message
+    void configure(const std::string& mode, uint32_t imageCountOverride);
+    void setRefreshRate(double hz); // 0 when unknown, the adaptive mode then stays on FIFO
+
+    bool adaptive() const { return isAdaptive; }
+
+    // The mode for the next swap chain, from the modes the surface supports
+    VkPresentModeKHR choose(const std::vector<VkPresentModeKHR>& available);
+    uint32_t imageCount(VkPresentModeKHR mode, const VkSurfaceCapabilitiesKHR& capabilities) const;
+
+    // Adaptive mode: called after every present with the time since the previous one.
+    // True when the policy switched modes and the swap chain has to be recreated
+    bool framePresented(double intervalMs);
+
+    static const char* name(VkPresentModeKHR mode);
+
+private:
+    VkPresentModeKHR requested = VK_PRESENT_MODE_MAILBOX_KHR;
+    bool isAdaptive = false;
+    uint32_t imageCountOverride = 0;
+
+    // Adaptive state. fallback is FIFO_RELAXED or IMMEDIATE, whichever the surface has
+    bool onFallback = false;
+    bool fallbackAvailable = false;
+    VkPresentModeKHR fallback = VK_PRESENT_MODE_FIFO_KHR;
+    double refreshIntervalMs = 0.0;
+    double windowMs = 0.0; // the frames are judged in windows of about a second
+    uint32_t windowFrames = 0;
+    uint32_t windowLate = 0;
+    uint32_t goodWindows = 0; // consecutive windows without late frames while on the fallback
+};
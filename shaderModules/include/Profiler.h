@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+CPU and GPU frame profiler (VULK_PROFILE=trace.json), exported in the Chrome trace event format.
+Open the file in chrome://tracing or ui.perfetto.dev to see where each frame's milliseconds go.
+# CPU zones are scoped with PROFILE_ZONE("name"). Every thread records into its own fixed-size ring,
+  so the hot path is two clock reads and a couple of atomics: no lock, no allocation, no shared cache line.
+  A full ring drops new zones (and counts them) instead of blocking the producing thread.
+# collect() drains the rings from one thread, once a frame from mainLoop, and keeps the events for the export.
+# When profiling is off a zone costs one relaxed atomic load, so the zones stay in release builds.
+# Zone names must be string literals (or otherwise outlive the profiler), only the pointer is stored.
+# Counters (recordCounter) are values over time, e.g. a latency per frame, and show up as a graph. They take a lock,
+  so they are meant for a few values per frame rather than for hot loops.
+*/
+class Profiler {
+public:
+    static void enable(uint32_t ringCapacity, size_t maxEvents);
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since the profiler epoch, the time base of CPU and GPU events alike
+    static uint64_t now();
+
+    static void setThreadName(const std::string& name);
+    static void record(const char* name, uint64_t beginNs, uint64_t endNs);
+    static void recordGpu(const char* name, uint64_t beginNs, uint64_t endNs);
+    static void recordCounter(const char* name, uint64_t atNs, double value);
+
+    static void collect();
+    static void writeChromeTrace(const std::string& path);
+
+private:
+    static std::atomic<bool> active;
+};
+
+// RAII zone, use through PROFILE_ZONE
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* zoneName) : name(Profiler::enabled() ? zoneName : nullptr), begin(name ? Profiler::now() : 0) {}
+    ~ProfileScope() {
+        if (name != nullptr) {
+            Profiler::record(name, begin, Profiler::now());
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t begin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+/*
+GPU timestamps around the passes of a frame, one block of queries per frame in flight.
+# beginFrame() is called right after the frame's fence wait, when its previous submission is known to be done.
+  That is when the block's old results are read (without VK_QUERY_RESULT_WAIT_BIT, they are already available),
+  so timings arrive maxFramesInFlight frames late and reading them never stalls the CPU or the GPU.
+# The block is then reset inside the command buffer and beginZone()/endZone() write TOP/BOTTOM_OF_PIPE timestamps.
+# GPU ticks have no defined relation to the CPU clock, each frame's first timestamp is placed at the CPU time
+  of its beginFrame(). Durations and the spacing within a frame are exact, the offset to the CPU track is not.
+*/
+class GpuProfiler {
+public:
+    // Leaves the profiler disabled when the queue family can't write timestamps
+    void init(const DeviceCapabilities& capabilities, VkDevice device, uint32_t queueFamily, uint32_t frameCount);
+    void destroy();
+
+    bool enabled() const { return queryPool != VK_NULL_HANDLE; }
+
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+    // Zones may nest. Past MAX_ZONES_PER_FRAME a frame's extra zones are skipped and beginZone returns NO_ZONE
+    uint32_t beginZone(VkCommandBuffer commandBuffer, const char* name);
+    void endZone(VkCommandBuffer commandBuffer, uint32_t zone);
+
+    // Reads the frames still in flight. Only once the device is idle, e.g. before exporting the trace
+    void flush();
+
+    static const uint32_t NO_ZONE = UINT32_MAX;
+
+private:
+    static const uint32_t MAX_ZONES_PER_FRAME = 16;
+
+    struct FrameQueries {
+        std::vector<const char*> names; // one per written zone
+        uint64_t cpuAnchor = 0; // Profiler::now() at beginFrame
+    };
+
+    void resolve(uint32_t frameIndex);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    double nanosecondsPerTick = 1.0;
+    uint64_t validMask = ~0ull;
+
+    std::vector<FrameQueries> frames;
+    uint32_t currentFrame = 0;
+};
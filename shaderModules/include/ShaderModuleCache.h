@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "SpirvBlob.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 128-bit content hash of a SPIR-V module. Fast, not cryptographic: it identifies bytecode we compiled ourselves
+struct SpirvHash {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const SpirvHash& other) const { return low == other.low && high == other.high; }
+
+    struct Hasher {
+        size_t operator()(const SpirvHash& hash) const { return static_cast<size_t>(hash.low); }
+    };
+};
+
+SpirvHash hashSpirv(const uint32_t* words, size_t wordCount);
+
+/*
+One VkShaderModule, shared by every pipeline built from the same bytecode.
+# With VK_EXT_shader_module_identifier the module is created lazily: a pipeline that hits the VkPipelineCache can be
+  built from the identifier alone, and the driver never has to parse the SPIR-V (see buildGraphicsPipeline).
+# Destroyed when the last reference goes away.
+*/
+class ShaderModule {
+public:
+    ShaderModule(VkDevice device, const SpirvHash& hash, std::shared_ptr<const SpirvBlob> code,
+                 PFN_vkGetShaderModuleCreateInfoIdentifierEXT getIdentifier);
+    ~ShaderModule();
+
+    ShaderModule(const ShaderModule&) = delete;
+    ShaderModule& operator=(const ShaderModule&) = delete;
+
+    VkShaderModule get(); // creates the module on first use, safe to call from several threads
+    bool created() const;
+
+    const SpirvHash& hash() const { return contentHash; }
+    const SpirvBlob& code() const { return *spirv; }
+    const std::vector<uint8_t>& identifier() const { return moduleIdentifier; } // empty without VK_EXT_shader_module_identifier
+
+private:
+    VkDevice device;
+    SpirvHash contentHash;
+    std::shared_ptr<const SpirvBlob> spirv;
+    std::vector<uint8_t> moduleIdentifier;
+
+    mutable std::mutex mutex;
+    VkShaderModule module = VK_NULL_HANDLE;
+};
+
+using ShaderModuleRef = std::shared_ptr<ShaderModule>;
+
+/*
+Content-addressed shader module cache.
+# Modules are looked up by the hash of their SPIR-V words, so identical bytecode (e.g. a vertex shader shared
+  by many materials, or a hot reload that didn't change the output) is handed to the driver only once.
+# The cache only holds weak references, a module lives as long as some program still uses it.
+# Lookups are guarded by a mutex so modules can be requested from several threads.
+*/
+class ShaderModuleCache {
+public:
+    // useIdentifiers: VK_EXT_shader_module_identifier is enabled on the device
+    void init(VkDevice device, bool useIdentifiers);
+    void destroy();
+
+    ShaderModuleRef acquire(std::shared_ptr<const SpirvBlob> code);
+
+    // Lookups that found a live module / had to create one, for the pipeline summary
+    size_t hits() const { return hitCount; }
+    size_t misses() const { return missCount; }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    PFN_vkGetShaderModuleCreateInfoIdentifierEXT getIdentifier = nullptr;
+
+    std::mutex mutex;
+    std::unordered_map<SpirvHash, std::weak_ptr<ShaderModule>, SpirvHash::Hasher> modules;
+    std::atomic<size_t> hitCount{0}; // read without the mutex
+    std::atomic<size_t> missCount{0};
+};
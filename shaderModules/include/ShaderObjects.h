@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "DynamicState.h"
+#include "GraphicsPipeline.h"
+#include "PipelineLayoutCache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// The shaders of one draw, plus the vertex input state a pipeline would have baked
+struct ShaderObjectSet {
+    std::vector<VkShaderStageFlagBits> stages;
+    std::vector<VkShaderEXT> shaders; // same order as stages
+    std::vector<VkVertexInputBindingDescription2EXT> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription2EXT> vertexAttributes;
+};
+
+/*
+VK_EXT_shader_object backend, the alternative to pipelines (VULK_SHADER_OBJECTS=1).
+# Every stage becomes its own VkShaderEXT, created from the same SPIR-V, reflection and specialization values
+  a GraphicsPipelineDesc hands to the pipeline path. Stages are unlinked, so a vertex shader can be paired with
+  any fragment shader without compiling the combination.
+# Nothing is baked: bind() sets everything a pipeline would hold (input assembly, raster, depth, multisample,
+  blend, vertex input) with vkCmdSet* per draw. Viewport and scissor are left to the caller, with the WithCount variants.
+# get() caches stages by bytecode hash, entry point, specialization values and layout. Each cached stage remembers the
+  owners (GraphicsPipelineDesc::owner) it was handed to, releaseOwner() destroys the ones no other owner uses, so a
+  replaced program takes its shaders with it. destroy() takes the rest.
+  build() creates a fresh set the caller releases, for measuring compile cost.
+# Shader objects have no render pass, draws with them are recorded between vkCmdBeginRendering and vkCmdEndRendering
+  (core dynamic rendering, which the backend needs enabled).
+# The descriptor set layouts come from layoutCache, so the shaders are compatible with the pipeline layout of the same stages.
+*/
+class ShaderObjectBackend {
+public:
+    void init(VkDevice device, PipelineLayoutCache& layoutCache);
+    void destroy();
+
+    ShaderObjectSet get(const GraphicsPipelineDesc& desc);
+    ShaderObjectSet build(const GraphicsPipelineDesc& desc);
+    void release(const ShaderObjectSet& set); // only for sets from build()
+    // Call once the GPU is done with every draw that bound the owner's shaders
+    void releaseOwner(const void* owner);
+
+    void bind(VkCommandBuffer commandBuffer, const ShaderObjectSet& set, const RasterState& raster) const;
+
+    size_t shaderCount() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const std::vector<uint32_t>& key) const;
+    };
+
+    struct CachedShader {
+        VkShaderEXT shader;
+        std::vector<const void*> owners;
+    };
+
+    ShaderObjectSet create(const GraphicsPipelineDesc& desc, bool cached);
+
+    VkDevice device = VK_NULL_HANDLE;
+    PipelineLayoutCache* layoutCache = nullptr;
+
+    PFN_vkCreateShadersEXT createShaders = nullptr;
+    PFN_vkDestroyShaderEXT destroyShader = nullptr;
+    PFN_vkCmdBindShadersEXT bindShaders = nullptr;
+    PFN_vkCmdSetVertexInputEXT setVertexInput = nullptr;
+    PFN_vkCmdSetPolygonModeEXT setPolygonMode = nullptr;
+    PFN_vkCmdSetRasterizationSamplesEXT setRasterizationSamples = nullptr;
+    PFN_vkCmdSetSampleMaskEXT setSampleMask = nullptr;
+    PFN_vkCmdSetAlphaToCoverageEnableEXT setAlphaToCoverageEnable = nullptr;
+    PFN_vkCmdSetColorBlendEnableEXT setColorBlendEnable = nullptr;
+    PFN_vkCmdSetColorWriteMaskEXT setColorWriteMask = nullptr;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::vector<uint32_t>, CachedShader, KeyHash> shaders;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "SpirvBlob.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Shader hot reload.
+# A background thread watches the GLSL source directory with inotify and recompiles a source with glslc
+  as soon as an editor finishes writing it. Nothing on the render thread ever waits for glslc.
+# Compiled modules are queued as SpirvBlobs under the name the app loads them by (shader.vert -> vert.spv),
+  the render loop picks them up with takeUpdates() at a frame boundary.
+# A source that fails to compile is reported and skipped, the app keeps running with the last good module.
+*/
+class ShaderWatcher {
+public:
+    struct Update {
+        std::string name; // e.g. "vert.spv"
+        SpirvBlob code;
+    };
+
+    ShaderWatcher() = default;
+    ~ShaderWatcher() { stop(); }
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // Throws std::runtime_error when the directory can't be watched
+    void start(const std::string& sourceDirectory, const std::string& glslc);
+    void stop();
+
+    bool running() const { return watcherThread.joinable(); }
+
+    // Modules compiled since the last call, at most one per name (the newest). Never blocks on a compile
+    std::vector<Update> takeUpdates();
+
+private:
+    void watchLoop();
+    void compile(const std::string& sourceName);
+
+    std::string directory;
+    std::string compiler;
+    int inotifyFd = -1;
+    int wakeFd = -1; // eventfd, written by stop() to get the thread out of poll()
+    std::thread watcherThread;
+
+    std::mutex mutex;
+    std::vector<Update> updates;
+};
+
+// Directory of the GLSL sources: VULK_SHADER_SOURCE_DIR, else the source tree the executable was built from
+std::string shaderSourceDirectory();
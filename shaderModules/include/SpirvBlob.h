@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+Read-only view of a SPIR-V binary that is memory-mapped straight from disk.
+# mmap hands back page-aligned memory, so the words can be passed to vkCreateShaderModule as a
+  const uint32_t* without copying them into a heap buffer first.
+# The header is validated on open (magic number, whole number of words, at least the 5-word header),
+  so a truncated or non-SPIR-V file fails here with a useful message instead of inside the driver.
+# The mapping is released when the blob goes out of scope. Blobs can be moved but not copied.
+# view() wraps words that already live in memory, so embedded and mapped shaders go through the same path.
+*/
+class SpirvBlob {
+public:
+    static constexpr uint32_t MAGIC = 0x07230203;
+    static constexpr size_t HEADER_WORDS = 5;
+
+    SpirvBlob() = default;
+    explicit SpirvBlob(const std::string& filename);
+    ~SpirvBlob();
+
+    SpirvBlob(SpirvBlob&& other) noexcept;
+    SpirvBlob& operator=(SpirvBlob&& other) noexcept;
+    SpirvBlob(const SpirvBlob&) = delete;
+    SpirvBlob& operator=(const SpirvBlob&) = delete;
+
+    const uint32_t* words() const { return data; }
+    size_t wordCount() const { return count; }
+    size_t sizeBytes() const { return count * sizeof(uint32_t); }
+    bool empty() const { return count == 0; }
+
+    // Non-owning blob over words that outlive it (e.g. the arrays embedded at build time). Validated like a mapped file
+    static SpirvBlob view(const uint32_t* words, size_t wordCount, const std::string& name);
+
+    // Checks the magic number and the word count of an in-memory SPIR-V module, throws std::runtime_error when invalid
+    static void validate(const uint32_t* words, size_t wordCount, const std::string& name);
+
+private:
+    void release();
+
+    const uint32_t* data = nullptr;
+    size_t count = 0;
+    size_t mappedBytes = 0; // 0 for views, nothing to unmap
+};
+
+// Directory that contains the running executable (resolved through /proc/self/exe)
+std::string executableDirectory();
+
+/*
+Resolves a shader file name to a path on disk, independent of the current working directory.
+Absolute paths are returned as-is, otherwise the first existing candidate of
+   # $VULK_SHADER_DIR/<name>
+   # <executable dir>/shaders/<name>
+   # <executable dir>/../shaders/<name>
+is used.
+*/
+std::string resolveShaderPath(const std::string& name);
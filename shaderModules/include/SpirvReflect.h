@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+SPIR-V reflection.
+# Walks the instruction stream of a module (the same words createShaderModule consumes) and pulls out what
+  the pipeline needs to know about it: entry points, stage inputs/outputs, descriptor bindings,
+  push constant blocks and specialization constants.
+# Pure CPU, no device needed, so it can run before the logical device exists.
+# From several reflected stages we build the pipeline layout description and the vertex input state,
+  instead of hand-maintaining those structs next to the shaders.
+*/
+
+// A stage input or output with a Location decoration (built-ins like gl_Position are skipped)
+struct SpirvInterfaceVariable {
+    std::string name;
+    uint32_t location = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t sizeBytes = 0;
+};
+
+struct SpirvEntryPoint {
+    std::string name;
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+    std::vector<SpirvInterfaceVariable> inputs; // sorted by location
+    std::vector<SpirvInterfaceVariable> outputs; // sorted by location
+};
+
+struct SpirvDescriptorBinding {
+    std::string name;
+    uint32_t set = 0;
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uint32_t count = 1; // product of the array dimensions, 0 for runtime (unsized) arrays
+};
+
+struct SpirvPushConstantBlock {
+    std::string name;
+    uint32_t offset = 0; // offset of the first member
+    uint32_t size = 0; // bytes from offset to the end of the last member
+};
+
+struct SpirvSpecConstant {
+    enum class Kind { Bool, Int, UInt, Float };
+
+    std::string name;
+    uint32_t constantId = 0; // layout(constant_id = N)
+    Kind kind = Kind::UInt;
+    uint32_t size = 4; // bytes, what VkSpecializationMapEntry::size must be
+    uint64_t defaultValue = 0; // raw bits of the default
+};
+
+struct ShaderReflection {
+    std::vector<SpirvEntryPoint> entryPoints;
+    VkShaderStageFlags stages = 0; // union of all entry point stages
+    std::vector<SpirvDescriptorBinding> descriptorBindings; // sorted by (set, binding)
+    std::vector<SpirvPushConstantBlock> pushConstants;
+    std::vector<SpirvSpecConstant> specConstants; // sorted by constantId
+};
+
+// Throws std::runtime_error on malformed modules
+ShaderReflection reflectSpirv(const uint32_t* words, size_t wordCount);
+
+// Everything needed to create a VkPipelineLayout. setBindings[i] holds the bindings of descriptor set i
+struct PipelineLayoutDesc {
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> setBindings;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+};
+
+/*
+Merges the resources of all stages of one pipeline.
+# A binding used by several stages gets the union of their stage flags.
+# The same (set, binding) with a different descriptor type or count is an error.
+# Push constant blocks are merged into one range covering every stage that uses them.
+*/
+PipelineLayoutDesc buildPipelineLayoutDesc(const std::vector<const ShaderReflection*>& stages);
+
+// Vertex input state derived from the vertex stage inputs: one interleaved per-vertex binding (0),
+// attributes packed in location order
+struct VertexInputDesc {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+    // The returned struct points into this object, keep it alive until the pipeline is created
+    VkPipelineVertexInputStateCreateInfo createInfo() const;
+};
+
+VertexInputDesc buildVertexInputDesc(const SpirvEntryPoint& vertexEntryPoint);
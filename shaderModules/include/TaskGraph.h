@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+/*
+Small dependency graph for startup work, which also times every step of it.
+# add() queues a task on the graph's own workers. It starts once all of its dependencies have finished.
+  Dependencies are always older tasks and the queue is FIFO, so a waiting task never holds up one it depends on.
+# runHere() runs a task on the calling thread, after its dependencies. For work that must stay on the main
+  thread (GLFW windows) or that is on the critical path anyway, so it still shows up in the report.
+# wait() rethrows what a task threw. A task whose dependency failed fails with the same exception.
+# With zero workers add() runs the task inline, which gives the serial baseline to compare against.
+*/
+class TaskGraph {
+public:
+    using TaskId = size_t;
+
+    void start(uint32_t workerCount);
+
+    TaskId add(const char* name, std::function<void()> work, std::vector<TaskId> dependencies = {});
+    TaskId runHere(const char* name, std::function<void()> work, std::vector<TaskId> dependencies = {});
+
+    void wait(TaskId task);
+    void finish(); // waits for every task and stops the workers
+
+    // One line per task: start and duration relative to start(), and the thread it ran on
+    void report() const;
+
+private:
+    struct Task {
+        const char* name;
+        std::shared_future<void> done;
+        double startMs = 0.0;
+        double durationMs = 0.0;
+        bool onWorker = false;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    ThreadPool pool;
+    std::vector<std::shared_ptr<Task>> tasks;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Fixed-size pool of worker threads pulling tasks from one FIFO queue.
+# submit() returns a std::future for the task's result, exceptions thrown by a task end up in its future.
+# stop() lets the workers finish everything already queued before joining them.
+# Without workers (before start(), after stop(), or started with 0 threads) submit() runs the task on the calling thread,
+  so every future gets its value.
+*/
+class ThreadPool {
+public:
+    ThreadPool() = default;
+    ~ThreadPool() { stop(); }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void start(uint32_t threadCount, const std::string& threadName = "pool worker"); // the name shows up in profiles
+    void stop();
+
+    uint32_t size() const { return static_cast<uint32_t>(workers.size()); }
+
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        // packaged_task is move-only and std::function needs something copyable, hence the shared_ptr
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        std::future<Result> future = packaged->get_future();
+        bool runInline = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            runInline = stopping || workers.empty();
+            if (!runInline) {
+                queue.emplace_back([packaged]() { (*packaged)(); });
+            }
+        }
+        if (runInline) {
+            (*packaged)();
+        } else {
+            wakeUp.notify_one();
+        }
+        return future;
+    }
+
+private:
+    void workerLoop(std::string threadName);
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
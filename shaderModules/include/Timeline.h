@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+
+/*
+One timeline semaphore per queue (Vulkan 1.2, VULK_TIMELINE_SEMAPHORES=0 goes back to fences).
+# Every submit to the queue signals the next value, so the value only ever grows and "value N reached" means
+  everything submitted up to and including submit N has finished on the GPU.
+# That one number replaces the per-frame fences: a frame remembers the value it signalled and waits for it before its
+  resources are reused, deferred deletions remember the value they were retired at, and another queue can wait on the
+  value directly instead of needing its own binary semaphore.
+# completed() caches the last value read back, reached() only asks the driver again when the cache is behind.
+*/
+class QueueTimeline {
+public:
+    void init(VkDevice device, const std::string& name);
+    void destroy();
+
+    bool valid() const { return semaphore != VK_NULL_HANDLE; }
+    VkSemaphore handle() const { return semaphore; }
+
+    // The value the next submit signals, every call hands out a new one
+    uint64_t nextValue() { return ++submitted; }
+    uint64_t lastSubmitted() const { return submitted; }
+
+    uint64_t completed();
+    bool reached(uint64_t value);
+    // Blocks until the GPU got there
+    void wait(uint64_t value);
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    std::string name;
+    uint64_t submitted = 0;
+    uint64_t completedValue = 0;
+};
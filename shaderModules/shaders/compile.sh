@@ -1,2 +1,7 @@
-/home/lak_02/vulkansdk/x86_64/bin/glslc shader.vert -o vert.spv
-/home/lak_02/vulkansdk/x86_64/bin/glslc shader.frag -o frag.spv
+#!/bin/sh
+# Compiles the shaders to loose .spv files for hot iteration (point VULK_SHADER_DIR at this directory).
+# Regular builds compile and embed them through CMake instead.
+GLSLC=${GLSLC:-${VULKAN_SDK:+$VULKAN_SDK/bin/}glslc}
+cd "$(dirname "$0")" || exit 1
+$GLSLC shader.vert -o vert.spv
+$GLSLC shader.frag -o frag.spv
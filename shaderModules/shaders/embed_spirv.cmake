@@ -0,0 +1,40 @@
+# Turns compiled SPIR-V files into a header of constexpr uint32_t word arrays.
+# Usage: cmake -DOUTPUT=<header> -DINPUTS=<a.spv|b.spv|...> -P embed_spirv.cmake
+# (the inputs are '|' separated because ';' does not survive add_custom_command)
+
+if (NOT OUTPUT OR NOT INPUTS)
+    message(FATAL_ERROR "embed_spirv.cmake needs -DOUTPUT=<header> and -DINPUTS=<spv files>")
+endif()
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+
+set(CONTENT "// Generated by shaders/embed_spirv.cmake, do not edit.\n#pragma once\n\n#include <cstddef>\n#include <cstdint>\n\n")
+set(TABLE "")
+
+foreach(INPUT ${INPUTS})
+    get_filename_component(NAME ${INPUT} NAME)
+    string(MAKE_C_IDENTIFIER ${NAME} IDENTIFIER)
+
+    file(READ ${INPUT} HEX HEX)
+    string(LENGTH "${HEX}" HEX_LENGTH)
+    math(EXPR REMAINDER "${HEX_LENGTH} % 8")
+    if (HEX_LENGTH EQUAL 0 OR NOT REMAINDER EQUAL 0)
+        message(FATAL_ERROR "${INPUT} is not a whole number of 32-bit words")
+    endif()
+
+    # The file holds little-endian words, so the bytes aa bb cc dd become the word 0xddccbbaa
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])" "0x\\4\\3\\2\\1, " WORDS "${HEX}")
+    # 8 words per line
+    string(REGEX REPLACE "((0x[0-9a-f]+, )(0x[0-9a-f]+, )(0x[0-9a-f]+, )(0x[0-9a-f]+, )(0x[0-9a-f]+, )(0x[0-9a-f]+, )(0x[0-9a-f]+, )(0x[0-9a-f]+, ))" "\\1\n    " WORDS "${WORDS}")
+
+    string(REPLACE ", \n" ",\n" WORDS "${WORDS}")
+    string(STRIP "${WORDS}" WORDS)
+
+    string(APPEND CONTENT "alignas(4) constexpr uint32_t ${IDENTIFIER}[] = {\n    ${WORDS}\n};\n\n")
+    string(APPEND TABLE "    {\"${NAME}\", ${IDENTIFIER}, sizeof(${IDENTIFIER}) / sizeof(uint32_t)},\n")
+endforeach()
+
+string(APPEND CONTENT "struct EmbeddedShader {\n    const char* name; // file name the module was compiled to, e.g. \"vert.spv\"\n    const uint32_t* words;\n    size_t wordCount;\n};\n\n")
+string(APPEND CONTENT "constexpr EmbeddedShader embeddedShaders[] = {\n${TABLE}};\n")
+
+file(WRITE ${OUTPUT} "${CONTENT}")
@@ -0,0 +1,196 @@
+#include "CoreFeatures.h"
+#include "Config.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+static const uint32_t FEATURE_COUNT = static_cast<uint32_t>(CoreFeature::Count);
+
+struct FeatureStructs {
+    VkPhysicalDeviceVulkan11Features* vulkan11;
+    VkPhysicalDeviceVulkan12Features* vulkan12;
+    VkPhysicalDeviceVulkan13Features* vulkan13;
+};
+
+// Every VkBool32 a feature needs. It is supported when all of them are
+static std::vector<VkBool32*> featureBits(CoreFeature feature, const FeatureStructs& s) {
+    switch (feature) {
+        case CoreFeature::TimelineSemaphore: return {&s.vulkan12->timelineSemaphore};
+        case CoreFeature::Synchronization2: return {&s.vulkan13->synchronization2};
+        case CoreFeature::DynamicRendering: return {&s.vulkan13->dynamicRendering};
+        case CoreFeature::DescriptorIndexing:
+            return {&s.vulkan12->descriptorIndexing, &s.vulkan12->runtimeDescriptorArray, &s.vulkan12->descriptorBindingPartiallyBound,
+                    &s.vulkan12->descriptorBindingVariableDescriptorCount, &s.vulkan12->shaderSampledImageArrayNonUniformIndexing};
+        case CoreFeature::BufferDeviceAddress: return {&s.vulkan12->bufferDeviceAddress};
+        case CoreFeature::StorageBuffer8Bit: return {&s.vulkan12->storageBuffer8BitAccess};
+        case CoreFeature::StorageBuffer16Bit: return {&s.vulkan11->storageBuffer16BitAccess};
+        case CoreFeature::Maintenance4: return {&s.vulkan13->maintenance4};
+        case CoreFeature::PipelineCreationCacheControl: return {&s.vulkan13->pipelineCreationCacheControl};
+        default: return {};
+    }
+}
+
+// Which of the structs holds it: 11, 12 or 13
+static uint32_t featureStruct(CoreFeature feature) {
+    switch (feature) {
+        case CoreFeature::StorageBuffer16Bit: return 11;
+        case CoreFeature::Synchronization2:
+        case CoreFeature::DynamicRendering:
+        case CoreFeature::Maintenance4:
+        case CoreFeature::PipelineCreationCacheControl: return 13;
+        default: return 12;
+    }
+}
+
+void CoreFeatureNegotiator::require(CoreFeature feature) {
+    requiredMask |= bit(feature);
+    requestedMask |= bit(feature);
+}
+
+void CoreFeatureNegotiator::request(CoreFeature feature) {
+    requestedMask |= bit(feature);
+}
+
+void CoreFeatureNegotiator::requestFromEnvironment() {
+    std::stringstream names(envString("VULK_DEVICE_FEATURES"));
+    std::string featureName;
+    while (std::getline(names, featureName, ',')) {
+        if (featureName.empty()) {
+            continue;
+        }
+        bool found = false;
+        for (uint32_t i = 0; i < FEATURE_COUNT; i++) {
+            if (featureName == name(static_cast<CoreFeature>(i))) {
+                request(static_cast<CoreFeature>(i));
+                found = true;
+            }
+        }
+        if (!found) {
+            std::cerr << "Unknown device feature " << featureName << " in VULK_DEVICE_FEATURES" << std::endl;
+        }
+    }
+}
+
+void CoreFeatureNegotiator::negotiate(VkPhysicalDevice device, uint32_t apiVersion) {
+    VkPhysicalDeviceVulkan11Features supported11{};
+    supported11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceVulkan13Features supported13{};
+    supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    // The Vulkan11/12Features structs came with 1.2, a 1.1 device only knows the per-feature structs. Left all zero, unsupported
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    if (apiVersion >= VK_API_VERSION_1_2) {
+        features2.pNext = &supported11;
+        supported11.pNext = &supported12;
+        if (apiVersion >= VK_API_VERSION_1_3) {
+            supported12.pNext = &supported13;
+        }
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+    }
+
+    vulkan11 = {};
+    vulkan11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    vulkan12 = {};
+    vulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan13 = {};
+    vulkan13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    FeatureStructs supportedStructs{&supported11, &supported12, &supported13};
+    FeatureStructs enableStructs{&vulkan11, &vulkan12, &vulkan13};
+    supportedMask = 0;
+    enabledMask = 0;
+    std::string missing;
+    for (uint32_t i = 0; i < FEATURE_COUNT; i++) {
+        CoreFeature feature = static_cast<CoreFeature>(i);
+        bool available = true;
+        for (VkBool32* value : featureBits(feature, supportedStructs)) {
+            available = available && *value == VK_TRUE;
+        }
+        if (available) {
+            supportedMask |= bit(feature);
+        }
+
+        if ((requestedMask & bit(feature)) == 0) {
+            continue;
+        }
+        if (!available) {
+            if ((requiredMask & bit(feature)) != 0) {
+                missing += missing.empty() ? name(feature) : std::string(", ") + name(feature);
+            }
+            continue;
+        }
+        for (VkBool32* value : featureBits(feature, enableStructs)) {
+            *value = VK_TRUE;
+        }
+        enabledMask |= bit(feature);
+    }
+
+    if (!missing.empty()) {
+        throw std::runtime_error("Device is missing required features: " + missing + "!");
+    }
+}
+
+void* CoreFeatureNegotiator::chain(void* next) {
+    bool use11 = false;
+    bool use12 = false;
+    bool use13 = false;
+    for (uint32_t i = 0; i < FEATURE_COUNT; i++) {
+        CoreFeature feature = static_cast<CoreFeature>(i);
+        if (enabled(feature)) {
+            use11 = use11 || featureStruct(feature) == 11;
+            use12 = use12 || featureStruct(feature) == 12;
+            use13 = use13 || featureStruct(feature) == 13;
+        }
+    }
+
+    void* head = next;
+    if (use13) {
+        vulkan13.pNext = head;
+        head = &vulkan13;
+    }
+    if (use12) {
+        vulkan12.pNext = head;
+        head = &vulkan12;
+    }
+    if (use11) {
+        vulkan11.pNext = head;
+        head = &vulkan11;
+    }
+    return head;
+}
+
+void CoreFeatureNegotiator::print() const {
+    std::string enabledNames;
+    std::string availableNames;
+    for (uint32_t i = 0; i < FEATURE_COUNT; i++) {
+        CoreFeature feature = static_cast<CoreFeature>(i);
+        std::string& list = enabled(feature) ? enabledNames : availableNames;
+        if (supported(feature)) {
+            list += list.empty() ? name(feature) : std::string(", ") + name(feature);
+        }
+    }
+    std::cout << "\tCore features enabled: " << (enabledNames.empty() ? "none" : enabledNames) << std::endl;
+    if (!availableNames.empty()) {
+        std::cout << "\tCore features available, not requested: " << availableNames << std::endl;
+    }
+}
+
+const char* CoreFeatureNegotiator::name(CoreFeature feature) {
+    switch (feature) {
+        case CoreFeature::TimelineSemaphore: return "timelineSemaphore";
+        case CoreFeature::Synchronization2: return "synchronization2";
+        case CoreFeature::DynamicRendering: return "dynamicRendering";
+        case CoreFeature::DescriptorIndexing: return "descriptorIndexing";
+        case CoreFeature::BufferDeviceAddress: return "bufferDeviceAddress";
+        case CoreFeature::StorageBuffer8Bit: return "storageBuffer8BitAccess";
+        case CoreFeature::StorageBuffer16Bit: return "storageBuffer16BitAccess";
+        case CoreFeature::Maintenance4: return "maintenance4";
+        case CoreFeature::PipelineCreationCacheControl: return "pipelineCreationCacheControl";
+        default: return "unknown";
+    }
+}
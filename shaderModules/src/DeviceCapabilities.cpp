@@ -0,0 +1,195 @@
+#include "DeviceCapabilities.h"
+#include "Config.h"
+#include "HexString.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Bump when the file layout changes. The struct sizes are stored too, so a header update that grows a struct also invalidates it
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const char SNAPSHOT_MAGIC[8] = {'V', 'U', 'L', 'K', 'C', 'A', 'P', 'S'};
+
+bool DeviceCapabilities::hasExtension(const char* name) const {
+    // Compares against the C string directly, a std::string per probe would allocate for most extension names
+    auto it = std::lower_bound(extensions.begin(), extensions.end(), name,
+                               [](const std::string& extension, const char* value) { return std::strcmp(extension.c_str(), value) < 0; });
+    return it != extensions.end() && std::strcmp(it->c_str(), name) == 0;
+}
+
+// The fields a snapshot must match to be reused, in file order
+static void writeKey(std::ostream& out, const VkPhysicalDeviceProperties& properties) {
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    uint32_t header[] = {SNAPSHOT_VERSION, properties.vendorID, properties.deviceID, properties.driverVersion, properties.apiVersion,
+                         static_cast<uint32_t>(sizeof(VkPhysicalDeviceFeatures)), static_cast<uint32_t>(sizeof(VkPhysicalDeviceMemoryProperties)),
+                         static_cast<uint32_t>(sizeof(VkQueueFamilyProperties))};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(properties.pipelineCacheUUID), VK_UUID_SIZE);
+}
+
+template <typename T>
+static void writePod(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readPod(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+static bool loadSnapshot(const std::string& path, DeviceCapabilities& capabilities) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Compare the key byte for byte against the one this device would write now
+    std::ostringstream expected;
+    writeKey(expected, capabilities.properties);
+    std::string key = expected.str();
+    std::string stored(key.size(), '\0');
+    if (!file.read(&stored[0], static_cast<std::streamsize>(stored.size())) || stored != key) {
+        return false;
+    }
+
+    DeviceCapabilities loaded;
+    uint32_t familyCount = 0;
+    if (!readPod(file, loaded.features) || !readPod(file, loaded.memory) || !readPod(file, familyCount) || familyCount > 64) {
+        return false;
+    }
+    loaded.queueFamilies.resize(familyCount);
+    for (auto& family : loaded.queueFamilies) {
+        if (!readPod(file, family)) {
+            return false;
+        }
+    }
+
+    uint32_t extensionCount = 0;
+    if (!readPod(file, extensionCount) || extensionCount > 4096) {
+        return false;
+    }
+    for (uint32_t i = 0; i < extensionCount; i++) {
+        uint32_t length = 0;
+        if (!readPod(file, length) || length > VK_MAX_EXTENSION_NAME_SIZE) {
+            return false;
+        }
+        std::string name(length, '\0');
+        if (!file.read(&name[0], length)) {
+            return false;
+        }
+        loaded.extensions.push_back(std::move(name));
+    }
+    if (!std::is_sorted(loaded.extensions.begin(), loaded.extensions.end())) {
+        return false;
+    }
+
+    capabilities.features = loaded.features;
+    capabilities.memory = loaded.memory;
+    capabilities.queueFamilies = std::move(loaded.queueFamilies);
+    capabilities.extensions = std::move(loaded.extensions);
+    return true;
+}
+
+static void saveSnapshot(const std::string& path, const DeviceCapabilities& capabilities) {
+    // Same temporary file and rename as the pipeline cache, a crash mid-write never leaves half a snapshot
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << tmpPath << " for writing" << std::endl;
+            return;
+        }
+        writeKey(file, capabilities.properties);
+        writePod(file, capabilities.features);
+        writePod(file, capabilities.memory);
+        writePod(file, static_cast<uint32_t>(capabilities.queueFamilies.size()));
+        for (const auto& family : capabilities.queueFamilies) {
+            writePod(file, family);
+        }
+        writePod(file, static_cast<uint32_t>(capabilities.extensions.size()));
+        for (const auto& name : capabilities.extensions) {
+            writePod(file, static_cast<uint32_t>(name.size()));
+            file.write(name.data(), static_cast<std::streamsize>(name.size()));
+        }
+        if (!file) {
+            std::cerr << "Failed to write device capabilities to " << tmpPath << std::endl;
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to replace device capabilities " << path << std::endl;
+        std::remove(tmpPath.c_str());
+    }
+}
+
+static void enumerateDevicePart(DeviceCapabilities& capabilities) {
+    VkPhysicalDevice device = capabilities.device;
+    vkGetPhysicalDeviceFeatures(device, &capabilities.features);
+    vkGetPhysicalDeviceMemoryProperties(device, &capabilities.memory);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, nullptr);
+    capabilities.queueFamilies.resize(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, capabilities.queueFamilies.data());
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> available(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, available.data());
+    for (const auto& extension : available) {
+        capabilities.extensions.push_back(extension.extensionName);
+    }
+    std::sort(capabilities.extensions.begin(), capabilities.extensions.end());
+}
+
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice device, VkSurfaceKHR surface, const std::string& cacheDirectory) {
+    DeviceCapabilities capabilities;
+    capabilities.device = device;
+    vkGetPhysicalDeviceProperties(device, &capabilities.properties);
+
+    if (capabilities.properties.apiVersion >= VK_API_VERSION_1_1) {
+        VkPhysicalDeviceIDProperties idProperties{};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &idProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties2);
+        std::memcpy(capabilities.deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+    }
+
+    // Two identical GPUs share a pipelineCacheUUID but not a deviceUUID. 1.0 devices have only the former
+    bool hasDeviceUUID = capabilities.properties.apiVersion >= VK_API_VERSION_1_1;
+    std::string dir = cacheDirectory.empty() ? envString("VULK_DEVICE_CACHE_DIR", ".") : cacheDirectory;
+    std::string path = dir + "/device_capabilities_" +
+                       bytesToHex(hasDeviceUUID ? capabilities.deviceUUID : capabilities.properties.pipelineCacheUUID, VK_UUID_SIZE) + ".bin";
+
+    bool useSnapshot = envFlag("VULK_DEVICE_CACHE", true);
+    capabilities.fromDisk = useSnapshot && loadSnapshot(path, capabilities);
+    if (!capabilities.fromDisk) {
+        enumerateDevicePart(capabilities);
+        if (useSnapshot) {
+            saveSnapshot(path, capabilities);
+        }
+    }
+
+    if (surface != VK_NULL_HANDLE) {
+        capabilities.presentSupport.resize(capabilities.queueFamilies.size(), VK_FALSE);
+        for (uint32_t i = 0; i < capabilities.queueFamilies.size(); i++) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &capabilities.presentSupport[i]);
+        }
+
+        uint32_t formatCount = 0;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+        capabilities.surfaceFormats.resize(formatCount);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, capabilities.surfaceFormats.data());
+
+        uint32_t presentModeCount = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+        capabilities.presentModes.resize(presentModeCount);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, capabilities.presentModes.data());
+    }
+    return capabilities;
+}
@@ -0,0 +1,167 @@
+#include "DeviceSelection.h"
+#include "HexString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <stdexcept>
+
+// Extensions this renderer has a faster path for when they are present
+static const char* const perfExtensionNames[] = {
+    VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+    VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
+    VK_EXT_SHADER_OBJECT_EXTENSION_NAME,
+    VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME,
+    VK_KHR_PRESENT_ID_EXTENSION_NAME,
+    VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+};
+
+// Fast paths that were promoted to core: a device of that version has them whether or not it still lists the extension,
+// so they count once either way
+struct PromotedExtension {
+    const char* name;
+    uint32_t coreVersion;
+};
+static const PromotedExtension promotedPerfExtensions[] = {
+    {VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME, VK_API_VERSION_1_3},
+};
+
+static const char* deviceTypeName(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+        default: return "other";
+    }
+}
+
+PhysicalDeviceCandidate describePhysicalDevice(const DeviceCapabilities& capabilities, uint32_t index) {
+    PhysicalDeviceCandidate candidate;
+    candidate.device = capabilities.device;
+    candidate.index = index;
+    candidate.name = capabilities.properties.deviceName;
+    candidate.type = capabilities.properties.deviceType;
+
+    // deviceUUID is core in 1.1. A 1.0 device only has the pipeline cache UUID, which changes with the driver
+    bool hasDeviceUUID = capabilities.properties.apiVersion >= VK_API_VERSION_1_1;
+    candidate.uuid = bytesToHex(hasDeviceUUID ? capabilities.deviceUUID : capabilities.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    for (uint32_t i = 0; i < capabilities.memory.memoryHeapCount; i++) {
+        if (capabilities.memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            candidate.deviceLocalBytes = std::max<uint64_t>(candidate.deviceLocalBytes, capabilities.memory.memoryHeaps[i].size);
+        }
+    }
+
+    for (const auto& family : capabilities.queueFamilies) {
+        bool graphics = family.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        bool compute = family.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        bool transfer = family.queueFlags & VK_QUEUE_TRANSFER_BIT;
+        candidate.dedicatedTransferQueue |= transfer && !graphics && !compute;
+        candidate.dedicatedComputeQueue |= compute && !graphics;
+    }
+
+    for (const char* name : perfExtensionNames) {
+        if (capabilities.hasExtension(name)) {
+            candidate.perfExtensions.push_back(name);
+        }
+    }
+    for (const PromotedExtension& promoted : promotedPerfExtensions) {
+        if (capabilities.properties.apiVersion >= promoted.coreVersion || capabilities.hasExtension(promoted.name)) {
+            candidate.perfExtensions.push_back(promoted.name);
+        }
+    }
+
+    candidate.maxImageDimension2D = capabilities.properties.limits.maxImageDimension2D;
+    candidate.maxComputeWorkGroupInvocations = capabilities.properties.limits.maxComputeWorkGroupInvocations;
+
+    candidate.score = scorePhysicalDevice(candidate);
+    return candidate;
+}
+
+int64_t scorePhysicalDevice(const PhysicalDeviceCandidate& candidate) {
+    int64_t score = 0;
+    switch (candidate.type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 100000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 50000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 20000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 0; break;
+        default: score += 10000; break;
+    }
+
+    // 100 per GiB, capped so the heap never outweighs the device type. Integrated GPUs report
+    // (part of) system memory as their device-local heap, which would otherwise look huge
+    const uint64_t gib = 1ull << 30;
+    score += static_cast<int64_t>(std::min<uint64_t>(candidate.deviceLocalBytes / gib, 64)) * 100;
+
+    score += candidate.dedicatedTransferQueue ? 500 : 0;
+    score += candidate.dedicatedComputeQueue ? 500 : 0;
+    score += static_cast<int64_t>(candidate.perfExtensions.size()) * 100;
+
+    // Limits only break ties between otherwise equal devices
+    score += std::min<uint32_t>(candidate.maxImageDimension2D / 4096, 8);
+    score += std::min<uint32_t>(candidate.maxComputeWorkGroupInvocations / 256, 8);
+    return score;
+}
+
+void rankPhysicalDevices(std::vector<PhysicalDeviceCandidate>& candidates) {
+    std::stable_sort(candidates.begin(), candidates.end(), [](const PhysicalDeviceCandidate& a, const PhysicalDeviceCandidate& b) {
+        if (a.suitable != b.suitable) {
+            return a.suitable;
+        }
+        return a.score > b.score;
+    });
+}
+
+const PhysicalDeviceCandidate* findRequestedDevice(const std::vector<PhysicalDeviceCandidate>& candidates, const std::string& selector) {
+    if (selector.empty()) {
+        return nullptr;
+    }
+
+    bool numeric = std::all_of(selector.begin(), selector.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    if (numeric && selector.size() < 8) {
+        uint32_t index = static_cast<uint32_t>(std::stoul(selector));
+        for (const auto& candidate : candidates) {
+            if (candidate.index == index) {
+                return &candidate;
+            }
+        }
+        throw std::runtime_error("VULK_DEVICE=" + selector + " is not a valid device index!");
+    }
+
+    // UUIDs are often written as 8-4-4-4-12, compare without the dashes and case-insensitively
+    std::string uuid;
+    for (char c : selector) {
+        if (c != '-') {
+            uuid += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+    for (const auto& candidate : candidates) {
+        if (candidate.uuid == uuid) {
+            return &candidate;
+        }
+    }
+    throw std::runtime_error("VULK_DEVICE=" + selector + " matches no device UUID!");
+}
+
+void printDeviceRanking(const std::vector<PhysicalDeviceCandidate>& candidates, const PhysicalDeviceCandidate& chosen) {
+    std::cout << "\n\tPhysical devices, best first:" << std::endl;
+    for (const auto& candidate : candidates) {
+        std::cout << "\t" << (candidate.device == chosen.device ? "* " : "  ") << "[" << candidate.index << "] " << candidate.name
+                  << " (" << deviceTypeName(candidate.type) << ", " << candidate.deviceLocalBytes / (1024 * 1024) << " MiB";
+        if (candidate.dedicatedTransferQueue) {
+            std::cout << ", transfer queue";
+        }
+        if (candidate.dedicatedComputeQueue) {
+            std::cout << ", compute queue";
+        }
+        std::cout << ", " << candidate.perfExtensions.size() << " perf extensions)";
+        if (candidate.suitable) {
+            std::cout << " score " << candidate.score;
+        } else {
+            std::cout << " unsuitable";
+        }
+        std::cout << "\n\t      uuid " << candidate.uuid << std::endl;
+    }
+}
@@ -0,0 +1,164 @@
+#include "DynamicState.h"
+
+#include <sstream>
+
+bool RasterState::operator==(const RasterState& other) const {
+    return topology == other.topology && primitiveRestart == other.primitiveRestart && polygonMode == other.polygonMode &&
+           cullMode == other.cullMode && frontFace == other.frontFace && depthTest == other.depthTest &&
+           depthWrite == other.depthWrite && depthCompareOp == other.depthCompareOp;
+}
+
+std::string RasterState::toString() const {
+    std::ostringstream text;
+    text << "topology=" << topology << (primitiveRestart ? "+restart" : "")
+         << " polygon=" << (polygonMode == VK_POLYGON_MODE_LINE ? "line" : polygonMode == VK_POLYGON_MODE_FILL ? "fill" : "other")
+         << " cull=" << (cullMode == VK_CULL_MODE_NONE ? "none" : cullMode == VK_CULL_MODE_BACK_BIT ? "back" : cullMode == VK_CULL_MODE_FRONT_BIT ? "front" : "both")
+         << " front=" << (frontFace == VK_FRONT_FACE_CLOCKWISE ? "cw" : "ccw")
+         << " depth=" << (depthTest ? "test" : "off") << (depthWrite ? "+write" : "");
+    return text.str();
+}
+
+uint32_t dynamicRasterBitsFor(bool extendedDynamicState, bool extendedDynamicState2, bool polygonMode) {
+    uint32_t bits = 0;
+    if (extendedDynamicState) {
+        bits |= DYNAMIC_RASTER_TOPOLOGY | DYNAMIC_RASTER_CULL_MODE | DYNAMIC_RASTER_FRONT_FACE | DYNAMIC_RASTER_DEPTH;
+    }
+    if (extendedDynamicState2) {
+        bits |= DYNAMIC_RASTER_PRIMITIVE_RESTART;
+    }
+    if (polygonMode) {
+        bits |= DYNAMIC_RASTER_POLYGON_MODE;
+    }
+    return bits;
+}
+
+std::vector<VkDynamicState> dynamicStatesFor(uint32_t mask) {
+    std::vector<VkDynamicState> states;
+    if (mask & DYNAMIC_RASTER_TOPOLOGY) {
+        states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY);
+    }
+    if (mask & DYNAMIC_RASTER_CULL_MODE) {
+        states.push_back(VK_DYNAMIC_STATE_CULL_MODE);
+    }
+    if (mask & DYNAMIC_RASTER_FRONT_FACE) {
+        states.push_back(VK_DYNAMIC_STATE_FRONT_FACE);
+    }
+    if (mask & DYNAMIC_RASTER_DEPTH) {
+        states.push_back(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE);
+        states.push_back(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE);
+        states.push_back(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP);
+    }
+    if (mask & DYNAMIC_RASTER_PRIMITIVE_RESTART) {
+        states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE);
+    }
+    if (mask & DYNAMIC_RASTER_POLYGON_MODE) {
+        states.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+    }
+    return states;
+}
+
+// Dynamic topology may only change within the topology class the pipeline was built with
+static VkPrimitiveTopology topologyClass(VkPrimitiveTopology topology) {
+    switch (topology) {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+        return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+        return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+        return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+    default:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+}
+
+RasterState canonicalRasterState(const RasterState& state, uint32_t mask) {
+    const RasterState defaults{};
+    RasterState canonical = state;
+    if (mask & DYNAMIC_RASTER_TOPOLOGY) {
+        // Only the topology class stays baked, e.g. every triangle topology can be set on a triangle list pipeline
+        canonical.topology = topologyClass(state.topology);
+    }
+    if (mask & DYNAMIC_RASTER_CULL_MODE) {
+        canonical.cullMode = defaults.cullMode;
+    }
+    if (mask & DYNAMIC_RASTER_FRONT_FACE) {
+        canonical.frontFace = defaults.frontFace;
+    }
+    if (mask & DYNAMIC_RASTER_DEPTH) {
+        canonical.depthTest = defaults.depthTest;
+        canonical.depthWrite = defaults.depthWrite;
+        canonical.depthCompareOp = defaults.depthCompareOp;
+    }
+    if (mask & DYNAMIC_RASTER_PRIMITIVE_RESTART) {
+        canonical.primitiveRestart = defaults.primitiveRestart;
+    }
+    if (mask & DYNAMIC_RASTER_POLYGON_MODE) {
+        canonical.polygonMode = defaults.polygonMode;
+    }
+    return canonical;
+}
+
+// Core 1.3 name first, the extension alias for 1.2 devices that expose it through VK_EXT_extended_dynamic_state(2)
+template <typename Function>
+static Function loadCommand(VkDevice device, const char* coreName, const char* extensionName) {
+    PFN_vkVoidFunction function = vkGetDeviceProcAddr(device, coreName);
+    if (function == nullptr && extensionName != nullptr) {
+        function = vkGetDeviceProcAddr(device, extensionName);
+    }
+    return reinterpret_cast<Function>(function);
+}
+
+void DynamicRasterState::init(VkDevice device, uint32_t supportedMask) {
+    dynamicMask = 0;
+
+    if (supportedMask & (DYNAMIC_RASTER_TOPOLOGY | DYNAMIC_RASTER_CULL_MODE | DYNAMIC_RASTER_FRONT_FACE | DYNAMIC_RASTER_DEPTH)) {
+        setPrimitiveTopology = loadCommand<PFN_vkCmdSetPrimitiveTopology>(device, "vkCmdSetPrimitiveTopology", "vkCmdSetPrimitiveTopologyEXT");
+        setCullMode = loadCommand<PFN_vkCmdSetCullMode>(device, "vkCmdSetCullMode", "vkCmdSetCullModeEXT");
+        setFrontFace = loadCommand<PFN_vkCmdSetFrontFace>(device, "vkCmdSetFrontFace", "vkCmdSetFrontFaceEXT");
+        setDepthTestEnable = loadCommand<PFN_vkCmdSetDepthTestEnable>(device, "vkCmdSetDepthTestEnable", "vkCmdSetDepthTestEnableEXT");
+        setDepthWriteEnable = loadCommand<PFN_vkCmdSetDepthWriteEnable>(device, "vkCmdSetDepthWriteEnable", "vkCmdSetDepthWriteEnableEXT");
+        setDepthCompareOp = loadCommand<PFN_vkCmdSetDepthCompareOp>(device, "vkCmdSetDepthCompareOp", "vkCmdSetDepthCompareOpEXT");
+
+        if (setPrimitiveTopology && setCullMode && setFrontFace && setDepthTestEnable && setDepthWriteEnable && setDepthCompareOp) {
+            dynamicMask |= supportedMask & (DYNAMIC_RASTER_TOPOLOGY | DYNAMIC_RASTER_CULL_MODE | DYNAMIC_RASTER_FRONT_FACE | DYNAMIC_RASTER_DEPTH);
+        }
+    }
+    if (supportedMask & DYNAMIC_RASTER_PRIMITIVE_RESTART) {
+        setPrimitiveRestartEnable = loadCommand<PFN_vkCmdSetPrimitiveRestartEnable>(device, "vkCmdSetPrimitiveRestartEnable", "vkCmdSetPrimitiveRestartEnableEXT");
+        if (setPrimitiveRestartEnable) {
+            dynamicMask |= DYNAMIC_RASTER_PRIMITIVE_RESTART;
+        }
+    }
+    if (supportedMask & DYNAMIC_RASTER_POLYGON_MODE) {
+        setPolygonMode = loadCommand<PFN_vkCmdSetPolygonModeEXT>(device, "vkCmdSetPolygonModeEXT", nullptr);
+        if (setPolygonMode) {
+            dynamicMask |= DYNAMIC_RASTER_POLYGON_MODE;
+        }
+    }
+}
+
+void DynamicRasterState::record(VkCommandBuffer commandBuffer, const RasterState& state) const {
+    if (dynamicMask & DYNAMIC_RASTER_TOPOLOGY) {
+        setPrimitiveTopology(commandBuffer, state.topology);
+    }
+    if (dynamicMask & DYNAMIC_RASTER_CULL_MODE) {
+        setCullMode(commandBuffer, state.cullMode);
+    }
+    if (dynamicMask & DYNAMIC_RASTER_FRONT_FACE) {
+        setFrontFace(commandBuffer, state.frontFace);
+    }
+    if (dynamicMask & DYNAMIC_RASTER_DEPTH) {
+        setDepthTestEnable(commandBuffer, state.depthTest ? VK_TRUE : VK_FALSE);
+        setDepthWriteEnable(commandBuffer, state.depthWrite ? VK_TRUE : VK_FALSE);
+        setDepthCompareOp(commandBuffer, state.depthCompareOp);
+    }
+    if (dynamicMask & DYNAMIC_RASTER_PRIMITIVE_RESTART) {
+        setPrimitiveRestartEnable(commandBuffer, state.primitiveRestart ? VK_TRUE : VK_FALSE);
+    }
+    if (dynamicMask & DYNAMIC_RASTER_POLYGON_MODE) {
+        setPolygonMode(commandBuffer, state.polygonMode);
+    }
+}
@@ -0,0 +1,190 @@
+#include "FramePacer.h"
+#include "Profiler.h"
+#include "Timeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// A minimized or hidden window may never present, render blind rather than hang
+static const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+
+// The sleep never takes more than this share of the refresh interval, the rest is left for recording and the GPU
+static const double MAX_SLEEP_FRACTION = 0.8;
+static const double SLEEP_STEP_NS = 100'000.0; // growth per on-time frame
+static const double MISS_BACKOFF_NS = 1'000'000.0; // the ceiling drops this far below the sleep that missed
+static const double CEILING_CREEP_NS = 2'000.0; // per on-time frame, about 0.1 ms per second at 60 Hz
+
+// A wait shorter than this returned without blocking: the frame was on screen already, at some unknown earlier time
+static const uint64_t MIN_BLOCKED_WAIT_NS = 50'000;
+
+void FramePacer::init(VkDevice logicalDevice, bool presentWait, uint32_t queueDepth) {
+    device = logicalDevice;
+    depth = std::max(1u, queueDepth);
+    if (presentWait) {
+        waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+    }
+    std::cout << "\tFrame pacing: " << (usesPresentWait() ? "present wait, depth " + std::to_string(depth) : std::string("fences")) << std::endl;
+}
+
+void FramePacer::setRefreshRate(double hz) {
+    refreshNs = hz > 0.0 ? static_cast<uint64_t>(1e9 / hz) : 0;
+    refreshFromMonitor = refreshNs != 0;
+    ceilingNs = refreshNs * MAX_SLEEP_FRACTION;
+}
+
+void FramePacer::beginFrame(VkSwapchainKHR swapChain, VkFence previousFrameFence, QueueTimeline* timeline, uint64_t previousFrameValue) {
+    if (!enabled()) {
+        return;
+    }
+    PROFILE_ZONE("frame pacing");
+
+    if (usesPresentWait()) {
+        if (swapChain != currentSwapChain) {
+            pending.clear();
+            currentSwapChain = swapChain;
+            lastPresentedNs = 0;
+        }
+
+        while (pending.size() >= depth) {
+            PendingFrame frame = pending.front();
+            pending.pop_front();
+
+            VkResult result;
+            uint64_t waitStartNs = Profiler::now();
+            {
+                PROFILE_ZONE("wait for present");
+                result = waitForPresent(device, swapChain, frame.presentId, PRESENT_WAIT_TIMEOUT_NS);
+            }
+            uint64_t waitEndNs = Profiler::now();
+            if (result == VK_SUCCESS && waitEndNs - waitStartNs >= MIN_BLOCKED_WAIT_NS) {
+                framePresented(frame, waitEndNs);
+            } else if (result == VK_SUCCESS) {
+                // Only says the present happened before now. Don't let the controller count that as late, and don't
+                // sleep from it: without an anchor this frame runs unpaced, so the next wait blocks again
+                unobserved++;
+                lastPresentedNs = 0;
+            } else {
+                // Timed out or out of date, start over with the next present
+                pending.clear();
+                lastPresentedNs = 0;
+            }
+        }
+
+        // The sleep counts from the vblank the last frame landed on
+        if (lastPresentedNs != 0 && sleepNs > 0.0) {
+            uint64_t wakeNs = lastPresentedNs + static_cast<uint64_t>(sleepNs);
+            uint64_t nowNs = Profiler::now();
+            if (wakeNs > nowNs) {
+                PROFILE_ZONE("pacing sleep");
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wakeNs - nowNs));
+            }
+        }
+    } else if (timeline != nullptr || previousFrameFence != VK_NULL_HANDLE) {
+        {
+            PROFILE_ZONE("wait for previous frame");
+            if (timeline != nullptr) {
+                timeline->wait(previousFrameValue);
+            } else {
+                vkWaitForFences(device, 1, &previousFrameFence, VK_TRUE, UINT64_MAX);
+            }
+        }
+        if (frameSubmittedInputNs != 0) {
+            uint64_t doneNs = Profiler::now();
+            double latencyMs = (doneNs - frameSubmittedInputNs) / 1e6;
+            frames++;
+            latencySumMs += latencyMs;
+            latencyMaxMs = std::max(latencyMaxMs, latencyMs);
+            Profiler::recordCounter("input to GPU done (ms)", doneNs, latencyMs);
+            frameSubmittedInputNs = 0;
+        }
+    }
+
+    frameInputNs = Profiler::now();
+}
+
+const void* FramePacer::presentId(VkSwapchainKHR swapChain) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    if (!usesPresentWait()) {
+        frameSubmittedInputNs = frameInputNs;
+        return nullptr;
+    }
+
+    if (swapChain != currentSwapChain) {
+        pending.clear();
+        currentSwapChain = swapChain;
+        lastPresentedNs = 0;
+    }
+
+    PendingFrame frame;
+    frame.presentId = nextPresentId++;
+    frame.inputNs = frameInputNs;
+    // Every frame still queued ahead of this one takes a refresh interval. After a pause (render on demand, a stall)
+    // the last present says nothing about the next vblank, don't predict then
+    bool paused = lastPresentedNs == 0 || refreshNs == 0 || frameInputNs > lastPresentedNs + refreshNs * (pending.size() + 4);
+    frame.predictedNs = paused ? 0 : lastPresentedNs + refreshNs * (pending.size() + 1);
+    pending.push_back(frame);
+
+    presentIdValue = frame.presentId;
+    presentIdInfo = {};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentIdValue;
+    return &presentIdInfo;
+}
+
+void FramePacer::framePresented(const PendingFrame& frame, uint64_t presentedNs) {
+    double latencyMs = (presentedNs - frame.inputNs) / 1e6;
+    frames++;
+    latencySumMs += latencyMs;
+    latencyMaxMs = std::max(latencyMaxMs, latencyMs);
+    Profiler::recordCounter("input to present (ms)", presentedNs, latencyMs);
+
+    // Without a monitor refresh rate, learn it from the intervals between on-time presents
+    if (lastPresentedNs != 0) {
+        uint64_t interval = presentedNs - lastPresentedNs;
+        if (refreshNs == 0) {
+            refreshNs = interval;
+            ceilingNs = refreshNs * MAX_SLEEP_FRACTION;
+        } else if (!refreshFromMonitor && interval < refreshNs * 3 / 2) {
+            refreshNs = (refreshNs * 15 + interval) / 16;
+        }
+    }
+
+    if (frame.predictedNs != 0) {
+        double errorNs = static_cast<double>(presentedNs) - static_cast<double>(frame.predictedNs);
+        predicted++;
+        errorSumMs += std::fabs(errorNs) / 1e6;
+        Profiler::recordCounter("present prediction error (ms)", presentedNs, errorNs / 1e6);
+
+        if (errorNs > refreshNs / 2.0) {
+            // Landed on a later vblank than predicted: sleep less, and don't grow back to where it went wrong for a while
+            missed++;
+            ceilingNs = std::max(0.0, sleepNs - MISS_BACKOFF_NS);
+            sleepNs = ceilingNs / 2.0;
+        } else {
+            ceilingNs = std::min(ceilingNs + CEILING_CREEP_NS, refreshNs * MAX_SLEEP_FRACTION);
+            sleepNs = std::min(sleepNs + SLEEP_STEP_NS, ceilingNs);
+        }
+    }
+    lastPresentedNs = presentedNs;
+}
+
+void FramePacer::report() const {
+    if (!enabled() || frames == 0) {
+        return;
+    }
+    if (usesPresentWait()) {
+        std::cout << "\tFrame pacing: input to present " << latencySumMs / frames << " ms average, " << latencyMaxMs << " ms max over "
+                  << frames << " frames, prediction off by " << (predicted > 0 ? errorSumMs / predicted : 0.0) << " ms on average, "
+                  << missed << " missed vblanks, sleeping " << sleepNs / 1e6 << " ms, " << unobserved
+                  << " presents already done before the wait" << std::endl;
+    } else {
+        std::cout << "\tFrame pacing: input to GPU done " << latencySumMs / frames << " ms average, " << latencyMaxMs << " ms max over "
+                  << frames << " frames" << std::endl;
+    }
+}
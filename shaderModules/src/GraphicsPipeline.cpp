@@ -0,0 +1,294 @@
+#include "GraphicsPipeline.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+/*
+Every create-info struct of one graphics pipeline, filled in from a GraphicsPipelineDesc.
+# Shared by the monolithic path and the pipeline library parts, which each hand the driver a subset of it.
+# The structs point into each other and into the vectors, so the object is neither copied nor moved.
+*/
+struct PipelineState {
+    std::vector<SpecializationData> specializations;
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    std::vector<VkPipelineShaderStageModuleIdentifierCreateInfoEXT> identifiers;
+    bool usesIdentifiers = false;
+
+    VertexInputDesc vertexInput;
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    std::vector<VkDynamicState> dynamicStates;
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    VkPipelineViewportStateCreateInfo viewportState{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+
+    // allowIdentifiers: stages whose module doesn't exist yet may be referenced by VK_EXT_shader_module_identifier
+    PipelineState(const GraphicsPipelineDesc& desc, bool allowIdentifiers);
+    PipelineState(const PipelineState&) = delete;
+    PipelineState& operator=(const PipelineState&) = delete;
+
+    // Replaces every identifier with the real module, for the retry after VK_PIPELINE_COMPILE_REQUIRED
+    void useModules(const GraphicsPipelineDesc& desc);
+};
+
+PipelineState::PipelineState(const GraphicsPipelineDesc& desc, bool allowIdentifiers)
+    : specializations(desc.stages.size()), shaderStages(desc.stages.size()), identifiers(desc.stages.size()) {
+    /*
+    To actually use the shaders we will need to assign them to a specific stage through VkPipelineShaderStageCreateInfo struct as part 
+    of the actual pipeline creation process.
+    */
+    const SpirvEntryPoint* vertexEntryPoint = nullptr;
+
+    for (size_t i = 0; i < desc.stages.size(); i++) {
+        const PipelineShaderStage& stage = desc.stages[i];
+        const SpirvEntryPoint& entryPoint = stage.reflection->entryPoints.at(stage.entryPointIndex);
+        if (entryPoint.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+            vertexEntryPoint = &entryPoint;
+        }
+
+        // Only the constants each stage actually declares end up in its specialization info
+        specializations[i] = buildSpecializationData(*stage.reflection, desc.specialization);
+
+        VkPipelineShaderStageCreateInfo& stageInfo = shaderStages[i];
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = entryPoint.stage; // Specifies in which pipeline stage the shader is gonna be used.
+        stageInfo.pName = entryPoint.name.c_str(); // Which function to invoke (entrypoint)
+        stageInfo.pSpecializationInfo = specializations[i].get(); // Values for the shader's specialization constants
+
+        // Specifies the shader module containing the code, or only its identifier if the module was never needed so far
+        const std::vector<uint8_t>& identifier = stage.module->identifier();
+        if (allowIdentifiers && !identifier.empty() && !stage.module->created()) {
+            identifiers[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+            identifiers[i].identifierSize = static_cast<uint32_t>(identifier.size());
+            identifiers[i].pIdentifier = identifier.data();
+            stageInfo.pNext = &identifiers[i];
+            stageInfo.module = VK_NULL_HANDLE;
+            usesIdentifiers = true;
+        } else {
+            stageInfo.module = stage.module->get();
+        }
+    }
+
+    if (vertexEntryPoint == nullptr) {
+        throw std::runtime_error("Graphics pipeline '" + desc.name + "' has no vertex stage!");
+    }
+
+    // Derived from the vertex shader inputs. shader.vert hardcodes its vertices, so this is empty for now
+    vertexInput = buildVertexInputDesc(*vertexEntryPoint);
+    vertexInputInfo = vertexInput.createInfo();
+
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = desc.raster.topology;
+    inputAssembly.primitiveRestartEnable = desc.raster.primitiveRestart ? VK_TRUE : VK_FALSE;
+
+    // Viewport and scissor are dynamic so the pipeline does not have to be rebuilt when the extent changes.
+    // Only their count is baked in, the actual values are set in recordCommandBuffer
+    dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    // Plus whatever raster state the extended dynamic state mode sets per draw
+    for (VkDynamicState state : dynamicStatesFor(desc.dynamicRaster)) {
+        dynamicStates.push_back(state);
+    }
+
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = desc.raster.polygonMode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = desc.raster.cullMode;
+    rasterizer.frontFace = desc.raster.frontFace;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Ignored while the render pass has no depth attachment, but kept so depth can be turned on per pipeline
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = desc.raster.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = desc.raster.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = desc.raster.depthCompareOp;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    // No blending, the fragment color is written straight to the attachment
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+}
+
+void PipelineState::useModules(const GraphicsPipelineDesc& desc) {
+    for (size_t i = 0; i < desc.stages.size(); i++) {
+        shaderStages[i].pNext = nullptr;
+        shaderStages[i].module = desc.stages[i].module->get();
+    }
+    usesIdentifiers = false;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+VkPipeline buildGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc) {
+    PROFILE_ZONE("build pipeline");
+    // Identifiers can only ever hit an existing cache entry, so they're pointless without a pipeline cache
+    PipelineState state(desc, pipelineCache != VK_NULL_HANDLE);
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(state.shaderStages.size());
+    pipelineInfo.pStages = state.shaderStages.data();
+    pipelineInfo.pVertexInputState = &state.vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+    pipelineInfo.pViewportState = &state.viewportState;
+    pipelineInfo.pRasterizationState = &state.rasterizer;
+    pipelineInfo.pMultisampleState = &state.multisampling;
+    pipelineInfo.pDepthStencilState = &state.depthStencil;
+    pipelineInfo.pColorBlendState = &state.colorBlending;
+    pipelineInfo.pDynamicState = &state.dynamicState;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = desc.subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    auto compileStart = std::chrono::steady_clock::now();
+    VkResult result = VK_PIPELINE_COMPILE_REQUIRED;
+    if (state.usesIdentifiers) {
+        pipelineInfo.flags = VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT;
+        result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+    }
+    bool builtFromIdentifiers = result == VK_SUCCESS;
+    if (result == VK_PIPELINE_COMPILE_REQUIRED) {
+        // Cache miss (or no identifiers at all): hand the driver the real modules and let it compile
+        state.useModules(desc);
+        pipelineInfo.flags = 0;
+        result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline '" + desc.name + "'!");
+    }
+    double compileMs = millisecondsSince(compileStart);
+
+    // Built as one string so lines from different worker threads don't interleave
+    std::ostringstream message;
+    message << "\tGraphics pipeline '" << desc.name << "' (" << desc.specialization.toString() << ") created in " << compileMs << " ms"
+            << (builtFromIdentifiers ? " from shader module identifiers" : "") << "\n";
+    std::cout << message.str() << std::flush;
+
+    return pipeline;
+}
+
+VkPipeline buildGraphicsPipelineLibrary(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc,
+                                        VkGraphicsPipelineLibraryFlagsEXT part) {
+    PipelineState state(desc, false);
+
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = part;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    // Keep what the optimizer needs, so an optimized link of these parts can be made later
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    // Every part gets the whole dynamic state list, each only takes the states that belong to it
+    pipelineInfo.pDynamicState = &state.dynamicState;
+
+    // Each part only gets the state it owns, everything else is ignored by the driver anyway
+    std::vector<VkPipelineShaderStageCreateInfo> stages;
+    if (part & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT) {
+        pipelineInfo.pVertexInputState = &state.vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+    }
+    if (part & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT) {
+        for (const auto& stage : state.shaderStages) {
+            if (stage.stage != VK_SHADER_STAGE_FRAGMENT_BIT) {
+                stages.push_back(stage);
+            }
+        }
+        pipelineInfo.pViewportState = &state.viewportState;
+        pipelineInfo.pRasterizationState = &state.rasterizer;
+        pipelineInfo.layout = desc.layout;
+        pipelineInfo.renderPass = desc.renderPass;
+        pipelineInfo.subpass = desc.subpass;
+    }
+    if (part & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) {
+        for (const auto& stage : state.shaderStages) {
+            if (stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+                stages.push_back(stage);
+            }
+        }
+        pipelineInfo.pMultisampleState = &state.multisampling;
+        pipelineInfo.pDepthStencilState = &state.depthStencil;
+        pipelineInfo.layout = desc.layout;
+        pipelineInfo.renderPass = desc.renderPass;
+        pipelineInfo.subpass = desc.subpass;
+    }
+    if (part & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT) {
+        pipelineInfo.pMultisampleState = &state.multisampling;
+        pipelineInfo.pColorBlendState = &state.colorBlending;
+        pipelineInfo.renderPass = desc.renderPass;
+        pipelineInfo.subpass = desc.subpass;
+    }
+    pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+    pipelineInfo.pStages = stages.empty() ? nullptr : stages.data();
+
+    VkPipeline library;
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &library) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline library part of '" + desc.name + "'!");
+    }
+    return library;
+}
+
+VkPipeline linkGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const std::vector<VkPipeline>& libraries,
+                                VkPipelineLayout layout, bool optimize, const std::string& name) {
+    VkPipelineLibraryCreateInfoKHR linkInfo{};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+    linkInfo.pLibraries = libraries.data();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &linkInfo;
+    // Without LINK_TIME_OPTIMIZATION the driver just stitches the precompiled parts together, which is the fast path
+    pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = layout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    auto linkStart = std::chrono::steady_clock::now();
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to link graphics pipeline '" + name + "'!");
+    }
+
+    std::ostringstream message;
+    message << "\tGraphics pipeline '" << name << "' " << (optimize ? "optimized link" : "fast-linked") << " in "
+            << millisecondsSince(linkStart) << " ms\n";
+    std::cout << message.str() << std::flush;
+
+    return pipeline;
+}
@@ -0,0 +1,249 @@
+#include "OffscreenTarget.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// First memory type allowed by typeBits that has all of the properties
+static uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Failed to find a suitable memory type!");
+}
+
+void OffscreenTarget::create(const DeviceCapabilities& capabilities, VkDevice logicalDevice, VkFormat imageFormat, VkExtent2D imageExtent, uint32_t imageCount) {
+    memoryProperties = capabilities.memory;
+    device = logicalDevice;
+    format = imageFormat;
+    extent = imageExtent;
+
+    colorImages.resize(imageCount, VK_NULL_HANDLE);
+    colorMemory.resize(imageCount, VK_NULL_HANDLE);
+    colorViews.resize(imageCount, VK_NULL_HANDLE);
+
+    for (uint32_t i = 0; i < imageCount; i++) {
+        // Same usage a swap chain image gets, plus TRANSFER_SRC so it can be read back
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent = {extent.width, extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &colorImages[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create offscreen image!");
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, colorImages[i], &requirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryProperties, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &colorMemory[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate offscreen image memory!");
+        }
+        vkBindImageMemory(device, colorImages[i], colorMemory[i], 0);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = colorImages[i];
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &colorViews[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create offscreen image view!");
+        }
+    }
+
+    std::cout << "\n\tOffscreen target created: " << imageCount << " images of " << extent.width << "x" << extent.height << std::endl;
+}
+
+void OffscreenTarget::destroy() {
+    for (size_t i = 0; i < colorImages.size(); i++) {
+        vkDestroyImageView(device, colorViews[i], nullptr);
+        vkDestroyImage(device, colorImages[i], nullptr);
+        vkFreeMemory(device, colorMemory[i], nullptr);
+    }
+    colorViews.clear();
+    colorImages.clear();
+    colorMemory.clear();
+}
+
+void OffscreenTarget::readback(VkCommandPool commandPool, VkQueue queue, uint32_t imageIndex, const std::string& path) const {
+    // Only 8-bit RGBA/BGRA, which covers every format we render to. The PPM gets the bytes as stored (sRGB encoded for *_SRGB)
+    bool bgra = format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+    if (!bgra && format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_R8G8B8A8_UNORM) {
+        throw std::runtime_error("Offscreen readback only supports 8-bit RGBA and BGRA formats!");
+    }
+    VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create readback buffer!");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+    // Host coherent, so no explicit invalidate is needed once the HOST barrier below made the copy visible
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        throw std::runtime_error("Failed to allocate readback memory!");
+    }
+
+    // Every way out below, error or not, goes through here so the staging buffer never leaks
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    void* mapped = nullptr;
+    auto release = [&]() {
+        if (mapped != nullptr) {
+            vkUnmapMemory(device, memory);
+        }
+        if (commandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        }
+        vkDestroyBuffer(device, buffer, nullptr);
+        vkFreeMemory(device, memory, nullptr);
+    };
+    auto fail = [&](const std::string& message) {
+        release();
+        throw std::runtime_error(message);
+    };
+
+    if (vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS) {
+        fail("Failed to bind readback memory!");
+    }
+
+    VkCommandBufferAllocateInfo commandInfo{};
+    commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandInfo.commandPool = commandPool;
+    commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &commandInfo, &commandBuffer) != VK_SUCCESS) {
+        commandBuffer = VK_NULL_HANDLE;
+        fail("Failed to allocate readback command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fail("Failed to begin readback command buffer!");
+    }
+
+    /*
+    # The frame leaves the image in TRANSFER_SRC_OPTIMAL (the render pass's finalLayout, or the barrier after dynamic rendering),
+      but nothing there makes the color writes visible to a transfer. This barrier does, the layout stays as it is.
+    */
+    VkImageMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = colorImages.at(imageIndex);
+    toTransfer.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    toTransfer.subresourceRange.baseMipLevel = 0;
+    toTransfer.subresourceRange.levelCount = 1;
+    toTransfer.subresourceRange.baseArrayLayer = 0;
+    toTransfer.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, colorImages.at(imageIndex), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+    // And the copied bytes available to the host before it maps them
+    VkMemoryBarrier toHost{};
+    toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &toHost, 0, nullptr, 0, nullptr);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        fail("Failed to record readback command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        fail("Failed to submit readback command buffer!");
+    }
+    if (vkQueueWaitIdle(queue) != VK_SUCCESS) {
+        fail("Failed to wait for the readback copy!");
+    }
+
+    if (vkMapMemory(device, memory, 0, size, 0, &mapped) != VK_SUCCESS) {
+        mapped = nullptr;
+        fail("Failed to map readback memory!");
+    }
+    const uint8_t* pixels = static_cast<const uint8_t*>(mapped);
+
+    // Binary PPM: a short text header and then RGB triplets, alpha is dropped
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+    std::vector<uint8_t> row(static_cast<size_t>(extent.width) * 3);
+    for (uint32_t y = 0; y < extent.height; y++) {
+        const uint8_t* source = pixels + static_cast<size_t>(y) * extent.width * 4;
+        for (uint32_t x = 0; x < extent.width; x++) {
+            row[x * 3 + 0] = source[x * 4 + (bgra ? 2 : 0)];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + (bgra ? 0 : 2)];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    bool written = static_cast<bool>(file);
+    file.close();
+
+    release();
+
+    if (!written) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+    std::cout << "\tRead back offscreen image " << imageIndex << " to " << path << std::endl;
+}
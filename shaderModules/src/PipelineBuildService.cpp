@@ -0,0 +1,56 @@
+#include "PipelineBuildService.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+void PipelineBuildService::start(VkDevice logicalDevice, VkPipelineCache cache, uint32_t workerCount, PipelineLibrary* pipelineLibrary) {
+    device = logicalDevice;
+    pipelineCache = cache;
+    library = pipelineLibrary;
+
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.start(workerCount, "pipeline worker");
+}
+
+void PipelineBuildService::stop() {
+    workers.stop();
+}
+
+std::shared_future<VkPipeline> PipelineBuildService::submit(GraphicsPipelineDesc desc, PipelineLinkMode mode) {
+    if (mode != PipelineLinkMode::Monolithic && library == nullptr) {
+        throw std::runtime_error("Pipeline link requested without a pipeline library!");
+    }
+
+    VkDevice logicalDevice = device;
+    VkPipelineCache cache = pipelineCache;
+    PipelineLibrary* parts = library;
+    return workers.submit([logicalDevice, cache, parts, mode, desc = std::move(desc)]() {
+        switch (mode) {
+        case PipelineLinkMode::FastLink:
+            return parts->fastLink(desc);
+        case PipelineLinkMode::OptimizedLink:
+            return parts->optimizedLink(desc);
+        default:
+            return buildGraphicsPipeline(logicalDevice, cache, desc);
+        }
+    }).share();
+}
+
+std::vector<std::shared_future<VkPipeline>> PipelineBuildService::submitBatch(std::vector<GraphicsPipelineDesc> descs) {
+    std::vector<std::shared_future<VkPipeline>> futures;
+    futures.reserve(descs.size());
+    for (auto& desc : descs) {
+        futures.push_back(submit(std::move(desc)));
+    }
+    return futures;
+}
+
+std::shared_future<ShaderObjectSet> PipelineBuildService::submitShaderObjects(GraphicsPipelineDesc desc, ShaderObjectBackend& backend) {
+    ShaderObjectBackend* shaders = &backend;
+    return workers.submit([shaders, desc = std::move(desc)]() {
+        return shaders->get(desc);
+    }).share();
+}
@@ -0,0 +1,121 @@
+#include "PipelineCache.h"
+#include "Config.h"
+#include "HexString.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+static std::vector<char> readBlob(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return {};
+    }
+    std::vector<char> blob(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(blob.data(), blob.size());
+    if (!file) {
+        return {};
+    }
+    return blob;
+}
+
+void PipelineCache::load(const DeviceCapabilities& capabilities, const std::string& directory) {
+    properties = capabilities.properties;
+
+    std::string dir = directory.empty() ? envString("VULK_PIPELINE_CACHE_DIR", ".") : directory;
+    path = dir + "/pipeline_cache_" + bytesToHex(properties.pipelineCacheUUID, VK_UUID_SIZE) + ".bin";
+
+    initialData = readBlob(path);
+    if (!initialData.empty() && !isCompatible(initialData)) {
+        std::cout << "\tDiscarding stale pipeline cache " << path << std::endl;
+        initialData.clear();
+    }
+}
+
+void PipelineCache::create(VkDevice logicalDevice) {
+    device = logicalDevice;
+    std::vector<char> blob = std::move(initialData);
+    initialData.clear();
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = blob.size();
+    createInfo.pInitialData = blob.empty() ? nullptr : blob.data();
+
+    if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS) {
+        // The header looked right but the driver still refused the payload, start over with an empty cache
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        blob.clear();
+        if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline cache!");
+        }
+    }
+
+    warm = !blob.empty();
+    std::cout << "\tPipeline cache " << (warm ? "loaded (" + std::to_string(blob.size()) + " bytes)" : "is cold") << std::endl;
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& blob) const {
+    // Layout of VkPipelineCacheHeaderVersionOne, the only header version defined by the spec
+    VkPipelineCacheHeaderVersionOne header;
+    if (blob.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, blob.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+           header.headerSize <= blob.size() &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID &&
+           header.deviceID == properties.deviceID &&
+           std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save() const {
+    if (cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> blob(size);
+    if (vkGetPipelineCacheData(device, cache, &size, blob.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to read back pipeline cache data" << std::endl;
+        return;
+    }
+
+    // Write to a temporary file first and rename it over the old blob, so a crash mid-write never leaves a truncated cache
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << tmpPath << " for writing" << std::endl;
+            return;
+        }
+        file.write(blob.data(), size);
+        if (!file) {
+            std::cerr << "Failed to write pipeline cache to " << tmpPath << std::endl;
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to replace pipeline cache " << path << std::endl;
+        std::remove(tmpPath.c_str());
+        return;
+    }
+
+    std::cout << "\tSaved pipeline cache (" << size << " bytes) to " << path << std::endl;
+}
+
+void PipelineCache::destroy() {
+    if (cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(device, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+}
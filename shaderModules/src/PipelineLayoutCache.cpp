@@ -0,0 +1,115 @@
+#include "PipelineLayoutCache.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Bindings are compared in binding order, so the order the caller listed them in doesn't matter
+static void appendBindings(std::vector<uint32_t>& key, std::vector<VkDescriptorSetLayoutBinding> bindings) {
+    std::sort(bindings.begin(), bindings.end(),
+        [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+    key.push_back(static_cast<uint32_t>(bindings.size()));
+    for (const auto& binding : bindings) {
+        if (binding.pImmutableSamplers != nullptr) {
+            throw std::runtime_error("Immutable samplers are not supported by the layout cache");
+        }
+        key.push_back(binding.binding);
+        key.push_back(static_cast<uint32_t>(binding.descriptorType));
+        key.push_back(binding.descriptorCount);
+        key.push_back(binding.stageFlags);
+    }
+}
+
+size_t PipelineLayoutCache::KeyHash::operator()(const std::vector<uint32_t>& key) const {
+    // FNV-1a over the words, the keys are short
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t word : key) {
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+void PipelineLayoutCache::init(VkDevice logicalDevice) {
+    device = logicalDevice;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return getSetLayoutLocked(bindings);
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayoutLocked(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    std::vector<uint32_t> key;
+    appendBindings(key, bindings);
+
+    auto it = setLayouts.find(key);
+    if (it != setLayouts.end()) {
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout setLayout;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout!");
+    }
+    setLayouts.emplace(std::move(key), setLayout);
+    return setLayout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const PipelineLayoutDesc& desc) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<uint32_t> key;
+    key.push_back(static_cast<uint32_t>(desc.setBindings.size()));
+    for (const auto& bindings : desc.setBindings) {
+        appendBindings(key, bindings);
+    }
+    key.push_back(static_cast<uint32_t>(desc.pushConstantRanges.size()));
+    for (const auto& range : desc.pushConstantRanges) {
+        key.push_back(range.stageFlags);
+        key.push_back(range.offset);
+        key.push_back(range.size);
+    }
+
+    auto it = pipelineLayouts.find(key);
+    if (it != pipelineLayouts.end()) {
+        return it->second;
+    }
+
+    // Sets that no stage uses still need a (empty) layout so the set numbers line up
+    std::vector<VkDescriptorSetLayout> setLayoutHandles;
+    for (const auto& bindings : desc.setBindings) {
+        setLayoutHandles.push_back(getSetLayoutLocked(bindings));
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayoutHandles.size());
+    pipelineLayoutInfo.pSetLayouts = setLayoutHandles.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(desc.pushConstantRanges.size());
+    pipelineLayoutInfo.pPushConstantRanges = desc.pushConstantRanges.data();
+
+    VkPipelineLayout pipelineLayout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+    pipelineLayouts.emplace(std::move(key), pipelineLayout);
+    return pipelineLayout;
+}
+
+void PipelineLayoutCache::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : pipelineLayouts) {
+        vkDestroyPipelineLayout(device, entry.second, nullptr);
+    }
+    for (auto& entry : setLayouts) {
+        vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+    }
+    pipelineLayouts.clear();
+    setLayouts.clear();
+}
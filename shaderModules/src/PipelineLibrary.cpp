@@ -0,0 +1,186 @@
+#include "PipelineLibrary.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static const VkGraphicsPipelineLibraryFlagsEXT ALL_PARTS[] = {
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+};
+
+static void appendHandle(std::vector<uint32_t>& key, const void* handle) {
+    uint64_t bits = reinterpret_cast<uintptr_t>(handle);
+    key.push_back(static_cast<uint32_t>(bits));
+    key.push_back(static_cast<uint32_t>(bits >> 32));
+}
+
+// Module hash plus the specialization values of every stage that goes into this part
+static void appendStages(std::vector<uint32_t>& key, const GraphicsPipelineDesc& desc, bool fragment) {
+    for (const auto& stage : desc.stages) {
+        bool isFragment = stage.reflection->entryPoints.at(stage.entryPointIndex).stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+        if (isFragment != fragment) {
+            continue;
+        }
+        const SpirvHash& hash = stage.module->hash();
+        key.insert(key.end(), {static_cast<uint32_t>(hash.low), static_cast<uint32_t>(hash.low >> 32),
+                               static_cast<uint32_t>(hash.high), static_cast<uint32_t>(hash.high >> 32), stage.entryPointIndex});
+
+        SpecializationData specialization = buildSpecializationData(*stage.reflection, desc.specialization);
+        key.push_back(static_cast<uint32_t>(specialization.entries.size()));
+        for (const auto& entry : specialization.entries) {
+            key.insert(key.end(), {entry.constantID, static_cast<uint32_t>(entry.size)});
+            // Every byte of the value in 32-bit words, 64-bit constants must not collide on their low half
+            for (size_t offset = 0; offset < entry.size; offset += sizeof(uint32_t)) {
+                uint32_t word = 0;
+                std::memcpy(&word, specialization.data.data() + entry.offset + offset, std::min<size_t>(entry.size - offset, sizeof(word)));
+                key.push_back(word);
+            }
+        }
+    }
+}
+
+// Everything a part depends on. The part flag comes first, so keys of different parts never collide
+static std::vector<uint32_t> partKey(const GraphicsPipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT part) {
+    std::vector<uint32_t> key = {part, desc.dynamicRaster};
+    const RasterState& raster = desc.raster;
+
+    switch (part) {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        key.insert(key.end(), {static_cast<uint32_t>(raster.topology), raster.primitiveRestart});
+        for (const auto& stage : desc.stages) {
+            const SpirvEntryPoint& entryPoint = stage.reflection->entryPoints.at(stage.entryPointIndex);
+            if (entryPoint.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+                for (const auto& input : entryPoint.inputs) {
+                    key.insert(key.end(), {input.location, static_cast<uint32_t>(input.format)});
+                }
+            }
+        }
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        appendStages(key, desc, false);
+        key.insert(key.end(), {static_cast<uint32_t>(raster.polygonMode), raster.cullMode, static_cast<uint32_t>(raster.frontFace), desc.subpass});
+        appendHandle(key, desc.layout);
+        appendHandle(key, desc.renderPass);
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        appendStages(key, desc, true);
+        key.insert(key.end(), {raster.depthTest, raster.depthWrite, static_cast<uint32_t>(raster.depthCompareOp), desc.subpass});
+        appendHandle(key, desc.layout);
+        appendHandle(key, desc.renderPass);
+        break;
+    default:
+        // Fragment output: blending and multisampling are fixed, only the render pass varies
+        key.push_back(desc.subpass);
+        appendHandle(key, desc.renderPass);
+        break;
+    }
+    return key;
+}
+
+size_t PipelineLibrary::KeyHash::operator()(const std::vector<uint32_t>& key) const {
+    // FNV-1a over the words, the keys are short
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t word : key) {
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+void PipelineLibrary::init(VkDevice logicalDevice, VkPipelineCache cache) {
+    device = logicalDevice;
+    pipelineCache = cache;
+}
+
+void PipelineLibrary::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : parts) {
+        // Parts that failed to compile have nothing to destroy
+        try {
+            vkDestroyPipeline(device, entry.second.pipeline.get(), nullptr);
+        } catch (const std::exception&) {
+        }
+    }
+    parts.clear();
+}
+
+std::vector<VkPipeline> PipelineLibrary::release(const void* owner) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<VkPipeline> released;
+    for (auto it = parts.begin(); it != parts.end();) {
+        std::vector<const void*>& owners = it->second.owners;
+        owners.erase(std::remove(owners.begin(), owners.end(), owner), owners.end());
+        // A part still compiling for nobody is left to destroy(), it can't be destroyed before it exists
+        if (!owners.empty() || it->second.pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        try {
+            released.push_back(it->second.pipeline.get());
+        } catch (const std::exception&) {
+            // Failed to compile, nothing to destroy
+        }
+        it = parts.erase(it);
+    }
+    return released;
+}
+
+size_t PipelineLibrary::partCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return parts.size();
+}
+
+VkPipeline PipelineLibrary::fastLink(const GraphicsPipelineDesc& desc) {
+    return link(desc, false);
+}
+
+VkPipeline PipelineLibrary::optimizedLink(const GraphicsPipelineDesc& desc) {
+    return link(desc, true);
+}
+
+VkPipeline PipelineLibrary::link(const GraphicsPipelineDesc& desc, bool optimize) {
+    PROFILE_ZONE(optimize ? "optimized link" : "fast link");
+    std::vector<VkPipeline> libraries;
+    for (VkGraphicsPipelineLibraryFlagsEXT part : ALL_PARTS) {
+        libraries.push_back(getPart(desc, part));
+    }
+    return linkGraphicsPipeline(device, pipelineCache, libraries, desc.layout, optimize, desc.name);
+}
+
+VkPipeline PipelineLibrary::getPart(const GraphicsPipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT part) {
+    std::vector<uint32_t> key = partKey(desc, part);
+
+    // The first thread to ask for a part compiles it, everyone else waits on the same future
+    std::promise<VkPipeline> promise;
+    std::shared_future<VkPipeline> existing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = parts.find(key);
+        if (it != parts.end()) {
+            existing = it->second.pipeline;
+        } else {
+            it = parts.emplace(key, Part{promise.get_future().share(), {}}).first;
+        }
+        // Registered under the lock, so a part found here can't be released before this owner is on it
+        std::vector<const void*>& owners = it->second.owners;
+        if (std::find(owners.begin(), owners.end(), desc.owner) == owners.end()) {
+            owners.push_back(desc.owner);
+        }
+    }
+    if (existing.valid()) {
+        return existing.get(); // waited on outside the lock, other parts can be looked up meanwhile
+    }
+
+    try {
+        VkPipeline library = buildGraphicsPipelineLibrary(device, pipelineCache, desc, part);
+        promise.set_value(library);
+        return library;
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
@@ -0,0 +1,330 @@
+#include "PipelineVariants.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+double SpecializationValue::floating() const {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::string SpecializationValue::toString() const {
+    switch (type) {
+        case Type::Bool: return bits != 0 ? "true" : "false";
+        case Type::Float: {
+            // Always with a '.' or an exponent so parse() reads it back as a float
+            std::ostringstream text;
+            text.precision(17);
+            text << floating();
+            std::string printed = text.str();
+            return printed.find_first_of(".en") == std::string::npos ? printed + ".0" : printed;
+        }
+        default: return std::to_string(integer());
+    }
+}
+
+static bool byConstantId(const std::pair<uint32_t, SpecializationValue>& entry, uint32_t id) {
+    return entry.first < id;
+}
+
+SpecializationKey& SpecializationKey::set(uint32_t constantId, SpecializationValue value) {
+    auto it = std::lower_bound(values.begin(), values.end(), constantId, byConstantId);
+    if (it != values.end() && it->first == constantId) {
+        it->second = value;
+    } else {
+        values.insert(it, {constantId, value});
+    }
+    return *this;
+}
+
+SpecializationKey& SpecializationKey::setBool(uint32_t constantId, bool value) {
+    return set(constantId, {SpecializationValue::Type::Bool, value ? 1u : 0u});
+}
+
+SpecializationKey& SpecializationKey::setInt(uint32_t constantId, int64_t value) {
+    return set(constantId, {SpecializationValue::Type::Integer, static_cast<uint64_t>(value)});
+}
+
+SpecializationKey& SpecializationKey::setFloat(uint32_t constantId, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return set(constantId, {SpecializationValue::Type::Float, bits});
+}
+
+const SpecializationValue* SpecializationKey::find(uint32_t constantId) const {
+    auto it = std::lower_bound(values.begin(), values.end(), constantId, byConstantId);
+    return (it != values.end() && it->first == constantId) ? &it->second : nullptr;
+}
+
+SpecializationKey SpecializationKey::parse(const std::string& text) {
+    SpecializationKey key;
+    std::stringstream stream(text);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        if (equals == std::string::npos || equals == 0 || equals + 1 == item.size()) {
+            throw std::runtime_error("Bad specialization entry '" + item + "', expected id=value");
+        }
+
+        std::string idText = item.substr(0, equals);
+        std::string valueText = item.substr(equals + 1);
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long constantId = std::strtoull(idText.c_str(), &end, 10);
+        if (*end != '\0' || errno == ERANGE || constantId > UINT32_MAX || idText[0] == '-') {
+            throw std::runtime_error("Bad specialization constant id '" + idText + "'");
+        }
+
+        bool hex = valueText.find("0x") != std::string::npos || valueText.find("0X") != std::string::npos;
+        errno = 0;
+        if (valueText == "true" || valueText == "false") {
+            key.setBool(static_cast<uint32_t>(constantId), valueText == "true");
+            end = nullptr;
+        } else if (!hex && valueText.find_first_of(".eE") != std::string::npos) {
+            key.setFloat(static_cast<uint32_t>(constantId), std::strtod(valueText.c_str(), &end));
+        } else if (valueText[0] == '-') {
+            key.setInt(static_cast<uint32_t>(constantId), std::strtoll(valueText.c_str(), &end, 0));
+        } else {
+            // Parsed unsigned so 32-bit uint masks like 0xFFFFFFFF fit, 64-bit values above INT64_MAX don't
+            unsigned long long value = std::strtoull(valueText.c_str(), &end, 0);
+            if (value > static_cast<unsigned long long>(INT64_MAX)) {
+                errno = ERANGE;
+            }
+            key.setInt(static_cast<uint32_t>(constantId), static_cast<int64_t>(value));
+        }
+        if ((end != nullptr && *end != '\0') || errno == ERANGE) {
+            throw std::runtime_error("Bad specialization value '" + valueText + "'");
+        }
+    }
+
+    return key;
+}
+
+std::string SpecializationKey::toString() const {
+    if (values.empty()) {
+        return "<defaults>";
+    }
+    std::string text;
+    for (const auto& entry : values) {
+        if (!text.empty()) {
+            text += ",";
+        }
+        text += std::to_string(entry.first) + "=" + entry.second.toString();
+    }
+    return text;
+}
+
+size_t SpecializationKey::Hash::operator()(const SpecializationKey& key) const {
+    uint64_t hash = 1469598103934665603ull;
+    for (const auto& entry : key.values) {
+        hash = (hash ^ entry.first) * 1099511628211ull;
+        hash = (hash ^ static_cast<uint64_t>(entry.second.type)) * 1099511628211ull;
+        hash = (hash ^ entry.second.bits) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+std::string PipelineVariantKey::toString() const {
+    return specialization.toString() + " " + raster.toString();
+}
+
+size_t PipelineVariantKey::Hash::operator()(const PipelineVariantKey& key) const {
+    const RasterState& raster = key.raster;
+    uint64_t hash = SpecializationKey::Hash()(key.specialization);
+    for (uint64_t field : {static_cast<uint64_t>(raster.topology), static_cast<uint64_t>(raster.primitiveRestart),
+                           static_cast<uint64_t>(raster.polygonMode), static_cast<uint64_t>(raster.cullMode),
+                           static_cast<uint64_t>(raster.frontFace), static_cast<uint64_t>(raster.depthTest),
+                           static_cast<uint64_t>(raster.depthWrite), static_cast<uint64_t>(raster.depthCompareOp)}) {
+        hash = (hash ^ field) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+const VkSpecializationInfo* SpecializationData::get() {
+    if (entries.empty()) {
+        return nullptr;
+    }
+    info.mapEntryCount = static_cast<uint32_t>(entries.size());
+    info.pMapEntries = entries.data();
+    info.dataSize = data.size();
+    info.pData = data.data();
+    return &info;
+}
+
+static std::string describeConstant(const SpirvSpecConstant& constant) {
+    return "specialization constant " + std::to_string(constant.constantId) +
+        (constant.name.empty() ? std::string() : " (" + constant.name + ")");
+}
+
+// The bytes of value as the constant's declared type, little-endian like the device expects
+static void convertSpecializationValue(const SpirvSpecConstant& constant, const SpecializationValue& value,
+                                       std::vector<uint8_t>& data) {
+    uint64_t bits = 0;
+    uint32_t size = constant.size;
+
+    switch (constant.kind) {
+        case SpirvSpecConstant::Kind::Bool:
+            if (value.type != SpecializationValue::Type::Bool) {
+                throw std::runtime_error(describeConstant(constant) + " is a bool, got " + value.toString() + "!");
+            }
+            // OpSpecConstantTrue/False have no width, the map entry is a VkBool32
+            bits = value.bits != 0 ? VK_TRUE : VK_FALSE;
+            size = sizeof(VkBool32);
+            break;
+
+        case SpirvSpecConstant::Kind::Int:
+        case SpirvSpecConstant::Kind::UInt: {
+            if (value.type != SpecializationValue::Type::Integer) {
+                throw std::runtime_error(describeConstant(constant) + " is an integer, got " + value.toString() + "!");
+            }
+            if (size != 1 && size != 2 && size != 4 && size != 8) {
+                throw std::runtime_error(describeConstant(constant) + " has an unsupported width!");
+            }
+            int64_t integer = value.integer();
+            bool fits;
+            if (constant.kind == SpirvSpecConstant::Kind::UInt) {
+                fits = integer >= 0 && (size == 8 || static_cast<uint64_t>(integer) < (1ull << (8 * size)));
+            } else {
+                int64_t limit = size == 8 ? INT64_MAX : static_cast<int64_t>((1ull << (8 * size - 1)) - 1);
+                fits = integer <= limit && integer >= -limit - 1;
+            }
+            if (!fits) {
+                throw std::runtime_error(value.toString() + " is out of range for " + std::to_string(8 * size) + "-bit " +
+                                         (constant.kind == SpirvSpecConstant::Kind::UInt ? "uint " : "int ") +
+                                         describeConstant(constant) + "!");
+            }
+            bits = static_cast<uint64_t>(integer);
+            break;
+        }
+
+        case SpirvSpecConstant::Kind::Float:
+            if (value.type != SpecializationValue::Type::Float) {
+                throw std::runtime_error(describeConstant(constant) + " is a float, got " + value.toString() + "!");
+            }
+            if (size == 8) {
+                bits = value.bits;
+            } else if (size == 4) {
+                float narrowed = static_cast<float>(value.floating());
+                uint32_t narrowedBits;
+                std::memcpy(&narrowedBits, &narrowed, sizeof(narrowedBits));
+                bits = narrowedBits;
+            } else {
+                throw std::runtime_error(describeConstant(constant) + " is a " + std::to_string(8 * size) +
+                                         "-bit float, only 32 and 64 bits can be specialized!");
+            }
+            break;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        data.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+}
+
+SpecializationData buildSpecializationData(const ShaderReflection& stage, const SpecializationKey& key) {
+    SpecializationData result;
+
+    for (const auto& constant : stage.specConstants) {
+        const SpecializationValue* value = key.find(constant.constantId);
+        if (value == nullptr) {
+            continue; // keep the shader's default
+        }
+
+        VkSpecializationMapEntry entry{};
+        entry.constantID = constant.constantId;
+        entry.offset = static_cast<uint32_t>(result.data.size());
+        convertSpecializationValue(constant, *value, result.data);
+        entry.size = static_cast<uint32_t>(result.data.size()) - entry.offset;
+        result.entries.push_back(entry);
+    }
+
+    return result;
+}
+
+// True once a build has finished with an exception, false while it is still running or when it produced a pipeline
+static bool buildFailed(const std::shared_future<VkPipeline>& pipeline) {
+    if (pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    try {
+        pipeline.get();
+        return false;
+    } catch (...) {
+        return true;
+    }
+}
+
+void PipelineVariantCache::init(VkDevice logicalDevice, BuildFunction buildFunction) {
+    device = logicalDevice;
+    build = std::move(buildFunction);
+}
+
+std::shared_future<VkPipeline> PipelineVariantCache::request(const PipelineVariantKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = variants.find(key);
+    if (it != variants.end()) {
+        if (!buildFailed(it->second)) {
+            return it->second;
+        }
+        // Whoever waited on the failed build has seen its error, the next request gets another try
+        variants.erase(it);
+    }
+
+    std::shared_future<VkPipeline> pipeline = build(key);
+    variants.emplace(key, pipeline);
+    return pipeline;
+}
+
+VkPipeline PipelineVariantCache::get(const PipelineVariantKey& key) {
+    return request(key).get();
+}
+
+VkPipeline PipelineVariantCache::replace(const PipelineVariantKey& key, VkPipeline pipeline) {
+    std::promise<VkPipeline> ready;
+    ready.set_value(pipeline);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = variants.find(key);
+    if (it == variants.end() || it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        throw std::runtime_error("Pipeline variant " + key.toString() + " can't be replaced before it is built!");
+    }
+    VkPipeline previous = it->second.get();
+    it->second = ready.get_future().share();
+    return previous;
+}
+
+size_t PipelineVariantCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return variants.size();
+}
+
+bool PipelineVariantCache::idle() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : variants) {
+        if (entry.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PipelineVariantCache::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : variants) {
+        // A variant that failed to build has nothing to destroy, its error was already reported to whoever waited on it
+        try {
+            vkDestroyPipeline(device, entry.second.get(), nullptr);
+        } catch (const std::exception&) {
+        }
+    }
+    variants.clear();
+}
@@ -0,0 +1,132 @@
+#include "PresentPolicy.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Share of late frames in a window that moves the adaptive mode off FIFO, and the share it must stay under to come back
+static const double FALLBACK_LATE_RATIO = 0.05;
+static const double RECOVER_LATE_RATIO = 0.01;
+static const uint32_t RECOVER_WINDOWS = 3; // consecutive good windows, so it doesn't flip back and forth every second
+
+void PresentModePolicy::configure(const std::string& mode, uint32_t imageCount) {
+    imageCountOverride = imageCount;
+    isAdaptive = false;
+
+    if (mode.empty() || mode == "mailbox") {
+        requested = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (mode == "immediate") {
+        requested = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else if (mode == "fifo") {
+        requested = VK_PRESENT_MODE_FIFO_KHR;
+    } else if (mode == "fifo_relaxed") {
+        requested = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    } else if (mode == "adaptive") {
+        requested = VK_PRESENT_MODE_FIFO_KHR;
+        isAdaptive = true;
+    } else {
+        std::cerr << "Unknown VULK_PRESENT_MODE " << mode << ", using mailbox" << std::endl;
+        requested = VK_PRESENT_MODE_MAILBOX_KHR;
+    }
+}
+
+void PresentModePolicy::setRefreshRate(double hz) {
+    refreshIntervalMs = hz > 0.0 ? 1000.0 / hz : 0.0;
+}
+
+VkPresentModeKHR PresentModePolicy::choose(const std::vector<VkPresentModeKHR>& available) {
+    auto supported = [&](VkPresentModeKHR mode) {
+        return std::find(available.begin(), available.end(), mode) != available.end();
+    };
+
+    if (isAdaptive) {
+        fallbackAvailable = true;
+        if (supported(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+            fallback = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+        } else if (supported(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+            fallback = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        } else {
+            fallbackAvailable = false;
+        }
+        return onFallback && fallbackAvailable ? fallback : VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    if (supported(requested)) {
+        return requested;
+    }
+    // FIFO is the one mode every surface has to support
+    if (requested != VK_PRESENT_MODE_MAILBOX_KHR) {
+        std::cout << "\tPresent mode " << name(requested) << " is not supported, using FIFO" << std::endl;
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t PresentModePolicy::imageCount(VkPresentModeKHR mode, const VkSurfaceCapabilitiesKHR& capabilities) const {
+    uint32_t count = 0;
+    if (imageCountOverride > 0) {
+        count = imageCountOverride;
+    } else if (mode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+        count = capabilities.minImageCount;
+    } else if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        count = std::max(capabilities.minImageCount + 1, 3u);
+    } else {
+        count = capabilities.minImageCount + 1;
+    }
+
+    // A maxImageCount of 0 means there is no maximum
+    count = std::max(count, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0) {
+        count = std::min(count, capabilities.maxImageCount);
+    }
+    return count;
+}
+
+bool PresentModePolicy::framePresented(double intervalMs) {
+    if (!isAdaptive || !fallbackAvailable || refreshIntervalMs <= 0.0) {
+        return false;
+    }
+
+    // On FIFO a frame that misses a vblank waits for the next one, so it shows up as about two refresh intervals.
+    // On the fallback a late frame is presented right away, anything noticeably over one interval is late
+    double lateThreshold = refreshIntervalMs * (onFallback ? 1.1 : 1.5);
+    windowMs += intervalMs;
+    windowFrames++;
+    if (intervalMs > lateThreshold) {
+        windowLate++;
+    }
+    if (windowMs < 1000.0) {
+        return false;
+    }
+
+    double lateRatio = static_cast<double>(windowLate) / windowFrames;
+    windowMs = 0.0;
+    windowFrames = 0;
+    windowLate = 0;
+
+    if (!onFallback) {
+        if (lateRatio > FALLBACK_LATE_RATIO) {
+            onFallback = true;
+            goodWindows = 0;
+            std::cout << "\tPresent mode: " << static_cast<int>(lateRatio * 100.0) << "% of frames missed a vblank, switching to "
+                      << name(fallback) << std::endl;
+            return true;
+        }
+    } else {
+        goodWindows = lateRatio < RECOVER_LATE_RATIO ? goodWindows + 1 : 0;
+        if (goodWindows >= RECOVER_WINDOWS) {
+            onFallback = false;
+            std::cout << "\tPresent mode: frames fit the refresh interval again, switching back to FIFO" << std::endl;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* PresentModePolicy::name(VkPresentModeKHR mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,326 @@
+#include "Profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+// Single producer (the owning thread), single consumer (collect). The producer only ever advances written
+// and the consumer only ever advances read, so neither side needs a lock
+struct ProfileRing {
+    uint32_t threadId = 0;
+    std::string threadName;
+    std::vector<ProfileEvent> events; // power of two sized
+    uint64_t mask = 0;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> read{0};
+    std::atomic<uint64_t> dropped{0};
+
+    void push(const char* name, uint64_t beginNs, uint64_t endNs) {
+        uint64_t w = written.load(std::memory_order_relaxed);
+        if (w - read.load(std::memory_order_acquire) > mask) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        events[w & mask] = {name, beginNs, endNs};
+        written.store(w + 1, std::memory_order_release);
+    }
+};
+
+struct CollectedEvent {
+    ProfileEvent event;
+    uint32_t threadId;
+};
+
+struct CounterEvent {
+    const char* name;
+    uint64_t atNs;
+    double value;
+};
+
+std::atomic<bool> Profiler::active{false};
+
+static const uint32_t GPU_THREAD_ID = 0; // enable() registers the GPU ring first, CPU threads are numbered from 1
+
+static const std::chrono::steady_clock::time_point profileEpoch = std::chrono::steady_clock::now();
+static uint32_t ringCapacity = 0;
+static size_t maxCollected = 0;
+
+// Rings are registered once per thread and never freed, so a thread that exits can still be drained
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+static ProfileRing* gpuRing = nullptr;
+static thread_local ProfileRing* threadRing = nullptr;
+
+static std::mutex collectMutex;
+static std::vector<CollectedEvent> collected;
+static std::vector<CounterEvent> counters; // under collectMutex as well
+static uint64_t collectDropped = 0;
+
+static ProfileRing* createRing(const std::string& name) {
+    auto ring = std::make_unique<ProfileRing>();
+    ring->events.resize(ringCapacity);
+    ring->mask = ringCapacity - 1;
+    ring->threadName = name;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    ring->threadId = static_cast<uint32_t>(rings.size());
+    rings.push_back(std::move(ring));
+    return rings.back().get();
+}
+
+static ProfileRing* currentRing() {
+    if (threadRing == nullptr) {
+        threadRing = createRing("thread");
+    }
+    return threadRing;
+}
+
+void Profiler::enable(uint32_t capacity, size_t maxEvents) {
+    // Round up to a power of two so the ring index is a mask
+    ringCapacity = 1;
+    while (ringCapacity < capacity) {
+        ringCapacity <<= 1;
+    }
+    maxCollected = maxEvents;
+
+    gpuRing = createRing("GPU graphics queue");
+    active.store(true, std::memory_order_release);
+}
+
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileEpoch).count());
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    if (!enabled()) {
+        return;
+    }
+    ProfileRing* ring = currentRing();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    ring->threadName = name;
+}
+
+void Profiler::record(const char* name, uint64_t beginNs, uint64_t endNs) {
+    currentRing()->push(name, beginNs, endNs);
+}
+
+void Profiler::recordGpu(const char* name, uint64_t beginNs, uint64_t endNs) {
+    gpuRing->push(name, beginNs, endNs);
+}
+
+void Profiler::recordCounter(const char* name, uint64_t atNs, double value) {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(collectMutex);
+    if (counters.size() < maxCollected) {
+        counters.push_back({name, atNs, value});
+    } else {
+        collectDropped++;
+    }
+}
+
+void Profiler::collect() {
+    if (!enabled()) {
+        return;
+    }
+
+    std::vector<ProfileRing*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& ring : rings) {
+            snapshot.push_back(ring.get());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(collectMutex);
+    for (ProfileRing* ring : snapshot) {
+        uint64_t r = ring->read.load(std::memory_order_relaxed);
+        uint64_t w = ring->written.load(std::memory_order_acquire);
+        for (; r < w; r++) {
+            if (collected.size() < maxCollected) {
+                collected.push_back({ring->events[r & ring->mask], ring->threadId});
+            } else {
+                collectDropped++;
+            }
+        }
+        ring->read.store(w, std::memory_order_release);
+    }
+}
+
+// Zone names are our own literals, but keep the JSON valid whatever they contain
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            escaped += ' ';
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+    if (!enabled()) {
+        return;
+    }
+    collect();
+
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path + " for the profile trace!");
+    }
+
+    uint64_t ringDropped = 0;
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    {
+        // Metadata first: the CPU and GPU tracks are separate processes, threads get their names
+        std::lock_guard<std::mutex> lock(registryMutex);
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}";
+        for (auto& ring : rings) {
+            file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << (ring->threadId == GPU_THREAD_ID ? 2 : 1)
+                 << ",\"tid\":" << ring->threadId << ",\"args\":{\"name\":\"" << jsonEscape(ring->threadName) << "\"}}";
+            ringDropped += ring->dropped.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(collectMutex);
+    // Complete events ("X") take a start and a duration, both in microseconds
+    file.precision(3);
+    file << std::fixed;
+    for (const CollectedEvent& collectedEvent : collected) {
+        const ProfileEvent& event = collectedEvent.event;
+        file << ",\n{\"name\":\"" << jsonEscape(event.name) << "\",\"ph\":\"X\",\"pid\":" << (collectedEvent.threadId == GPU_THREAD_ID ? 2 : 1)
+             << ",\"tid\":" << collectedEvent.threadId << ",\"ts\":" << event.beginNs / 1000.0
+             << ",\"dur\":" << (event.endNs - event.beginNs) / 1000.0 << "}";
+    }
+    // Counter events ("C") are drawn as a graph above the CPU threads
+    for (const CounterEvent& counter : counters) {
+        file << ",\n{\"name\":\"" << jsonEscape(counter.name) << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << counter.atNs / 1000.0
+             << ",\"args\":{\"value\":" << counter.value << "}}";
+    }
+    file << "\n]}\n";
+
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+    std::cout << "\tProfile: " << collected.size() << " zones and " << counters.size() << " counter values written to " << path;
+    if (ringDropped + collectDropped > 0) {
+        std::cout << " (" << ringDropped + collectDropped << " dropped, raise VULK_PROFILE_RING or VULK_PROFILE_MAX_EVENTS)";
+    }
+    std::cout << std::endl;
+}
+
+void GpuProfiler::init(const DeviceCapabilities& capabilities, VkDevice logicalDevice, uint32_t queueFamily, uint32_t frameCount) {
+    device = logicalDevice;
+
+    // timestampValidBits == 0 means the queue can't write timestamps at all
+    const std::vector<VkQueueFamilyProperties>& families = capabilities.queueFamilies;
+    uint32_t validBits = queueFamily < families.size() ? families[queueFamily].timestampValidBits : 0;
+    if (validBits == 0) {
+        std::cout << "\tGPU timestamps: not supported on the graphics queue" << std::endl;
+        return;
+    }
+    validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    nanosecondsPerTick = capabilities.properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frameCount * MAX_ZONES_PER_FRAME * 2;
+
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
+    frames.assign(frameCount, FrameQueries{});
+
+    std::cout << "\tGPU timestamps: " << validBits << " valid bits, " << nanosecondsPerTick << " ns per tick" << std::endl;
+}
+
+void GpuProfiler::destroy() {
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+    frames.clear();
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (!enabled()) {
+        return;
+    }
+    currentFrame = frameIndex;
+    resolve(frameIndex);
+
+    FrameQueries& frame = frames[frameIndex];
+    frame.names.clear();
+    frame.cpuAnchor = Profiler::now();
+    vkCmdResetQueryPool(commandBuffer, queryPool, frameIndex * MAX_ZONES_PER_FRAME * 2, MAX_ZONES_PER_FRAME * 2);
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer commandBuffer, const char* name) {
+    if (!enabled() || frames[currentFrame].names.size() >= MAX_ZONES_PER_FRAME) {
+        return NO_ZONE;
+    }
+    FrameQueries& frame = frames[currentFrame];
+    uint32_t zone = static_cast<uint32_t>(frame.names.size());
+    frame.names.push_back(name);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, (currentFrame * MAX_ZONES_PER_FRAME + zone) * 2);
+    return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer commandBuffer, uint32_t zone) {
+    if (zone == NO_ZONE) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (currentFrame * MAX_ZONES_PER_FRAME + zone) * 2 + 1);
+}
+
+void GpuProfiler::flush() {
+    for (uint32_t i = 0; i < frames.size(); i++) {
+        resolve(i);
+        frames[i].names.clear();
+    }
+}
+
+void GpuProfiler::resolve(uint32_t frameIndex) {
+    FrameQueries& frame = frames[frameIndex];
+    if (frame.names.empty()) {
+        return;
+    }
+
+    // The frame's fence has been waited on, so this doesn't block. VK_NOT_READY would mean the frame was
+    // never submitted, its zones are skipped then
+    uint32_t queryCount = static_cast<uint32_t>(frame.names.size()) * 2;
+    std::vector<uint64_t> ticks(queryCount);
+    VkResult result = vkGetQueryPoolResults(device, queryPool, frameIndex * MAX_ZONES_PER_FRAME * 2, queryCount,
+                                            ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    // Masked differences stay correct across one wrap of a counter narrower than 64 bits
+    uint64_t origin = ticks[0];
+    for (size_t zone = 0; zone < frame.names.size(); zone++) {
+        uint64_t begin = (ticks[zone * 2] - origin) & validMask;
+        uint64_t end = (ticks[zone * 2 + 1] - origin) & validMask;
+        Profiler::recordGpu(frame.names[zone], frame.cpuAnchor + static_cast<uint64_t>(begin * nanosecondsPerTick),
+                            frame.cpuAnchor + static_cast<uint64_t>(end * nanosecondsPerTick));
+    }
+}
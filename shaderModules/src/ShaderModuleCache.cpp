@@ -0,0 +1,138 @@
+#include "ShaderModuleCache.h"
+
+#include <cstring>
+#include <iterator>
+#include <iostream>
+#include <stdexcept>
+
+static uint64_t rotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// MurmurHash3 finalizer, spreads every input bit over the whole word
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+SpirvHash hashSpirv(const uint32_t* words, size_t wordCount) {
+    // Two independent 64-bit lanes over 64-bit chunks, combined at the end
+    uint64_t low = 0x9e3779b97f4a7c15ULL ^ wordCount;
+    uint64_t high = 0xc2b2ae3d27d4eb4fULL;
+
+    size_t i = 0;
+    for (; i + 1 < wordCount; i += 2) {
+        uint64_t chunk = static_cast<uint64_t>(words[i]) | (static_cast<uint64_t>(words[i + 1]) << 32);
+        low = rotateLeft(low ^ mix64(chunk), 27) * 5 + 0x52dce729;
+        high = rotateLeft(high ^ mix64(chunk + 0x9e3779b97f4a7c15ULL), 31) * 5 + 0x38495ab5;
+    }
+    if (i < wordCount) {
+        low ^= mix64(words[i]);
+        high ^= mix64(static_cast<uint64_t>(words[i]) << 32);
+    }
+
+    SpirvHash hash;
+    hash.low = mix64(low + high);
+    hash.high = mix64(high + hash.low);
+    return hash;
+}
+
+ShaderModule::ShaderModule(VkDevice logicalDevice, const SpirvHash& hash, std::shared_ptr<const SpirvBlob> code,
+                           PFN_vkGetShaderModuleCreateInfoIdentifierEXT getIdentifier)
+    : device(logicalDevice), contentHash(hash), spirv(std::move(code)) {
+    if (getIdentifier == nullptr) {
+        return;
+    }
+
+    // The identifier is computed from the create info, no module has to exist for it
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = spirv->sizeBytes();
+    createInfo.pCode = spirv->words();
+
+    VkShaderModuleIdentifierEXT identifier{};
+    identifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+    getIdentifier(device, &createInfo, &identifier);
+    moduleIdentifier.assign(identifier.identifier, identifier.identifier + identifier.identifierSize);
+}
+
+ShaderModule::~ShaderModule() {
+    if (module != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(device, module, nullptr);
+    }
+}
+
+VkShaderModule ShaderModule::get() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (module != VK_NULL_HANDLE) {
+        return module;
+    }
+
+    // codeSize is in bytes, pCode is a uint32_t pointer. The blob is either mmap'd (page aligned) or an alignas(4) array
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = spirv->sizeBytes();
+    createInfo.pCode = spirv->words();
+
+    if (vkCreateShaderModule(device, &createInfo, nullptr, &module) != VK_SUCCESS) {
+        module = VK_NULL_HANDLE;
+        throw std::runtime_error("Failed to create shader module!");
+    }
+    return module;
+}
+
+bool ShaderModule::created() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return module != VK_NULL_HANDLE;
+}
+
+void ShaderModuleCache::init(VkDevice logicalDevice, bool useIdentifiers) {
+    device = logicalDevice;
+    getIdentifier = nullptr;
+    if (useIdentifiers) {
+        getIdentifier = reinterpret_cast<PFN_vkGetShaderModuleCreateInfoIdentifierEXT>(
+            vkGetDeviceProcAddr(device, "vkGetShaderModuleCreateInfoIdentifierEXT"));
+    }
+}
+
+void ShaderModuleCache::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : modules) {
+        if (!entry.second.expired()) {
+            std::cerr << "Shader module cache destroyed while a module is still referenced!" << std::endl;
+        }
+    }
+    modules.clear();
+}
+
+ShaderModuleRef ShaderModuleCache::acquire(std::shared_ptr<const SpirvBlob> code) {
+    SpirvHash hash = hashSpirv(code->words(), code->wordCount());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = modules.find(hash);
+    if (it != modules.end()) {
+        if (ShaderModuleRef live = it->second.lock()) {
+            hitCount++;
+            return live;
+        }
+    }
+
+    missCount++;
+    // A miss means new bytecode, usually a hot reload. Drop the entries of modules whose programs are gone by now,
+    // otherwise every reloaded blob would leave one behind
+    for (auto entry = modules.begin(); entry != modules.end();) {
+        entry = entry->second.expired() ? modules.erase(entry) : std::next(entry);
+    }
+
+    auto module = std::make_shared<ShaderModule>(device, hash, std::move(code), getIdentifier);
+    if (module->identifier().empty()) {
+        // Nothing to gain from waiting, and creating it now reports bad bytecode where it was loaded
+        module->get();
+    }
+    modules[hash] = module;
+    return module;
+}
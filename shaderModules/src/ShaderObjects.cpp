@@ -0,0 +1,271 @@
+#include "ShaderObjects.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+template <typename Function>
+static Function loadCommand(VkDevice device, const char* name) {
+    PFN_vkVoidFunction function = vkGetDeviceProcAddr(device, name);
+    if (function == nullptr) {
+        throw std::runtime_error(std::string("VK_EXT_shader_object is enabled but ") + name + " is missing!");
+    }
+    return reinterpret_cast<Function>(function);
+}
+
+static void appendHandle(std::vector<uint32_t>& key, const void* handle) {
+    uint64_t bits = reinterpret_cast<uintptr_t>(handle);
+    key.push_back(static_cast<uint32_t>(bits));
+    key.push_back(static_cast<uint32_t>(bits >> 32));
+}
+
+void ShaderObjectBackend::init(VkDevice logicalDevice, PipelineLayoutCache& layouts) {
+    device = logicalDevice;
+    layoutCache = &layouts;
+
+    // Only the shader object entry points themselves and the state they made dynamic, the rest is core 1.3
+    createShaders = loadCommand<PFN_vkCreateShadersEXT>(device, "vkCreateShadersEXT");
+    destroyShader = loadCommand<PFN_vkDestroyShaderEXT>(device, "vkDestroyShaderEXT");
+    bindShaders = loadCommand<PFN_vkCmdBindShadersEXT>(device, "vkCmdBindShadersEXT");
+    setVertexInput = loadCommand<PFN_vkCmdSetVertexInputEXT>(device, "vkCmdSetVertexInputEXT");
+    setPolygonMode = loadCommand<PFN_vkCmdSetPolygonModeEXT>(device, "vkCmdSetPolygonModeEXT");
+    setRasterizationSamples = loadCommand<PFN_vkCmdSetRasterizationSamplesEXT>(device, "vkCmdSetRasterizationSamplesEXT");
+    setSampleMask = loadCommand<PFN_vkCmdSetSampleMaskEXT>(device, "vkCmdSetSampleMaskEXT");
+    setAlphaToCoverageEnable = loadCommand<PFN_vkCmdSetAlphaToCoverageEnableEXT>(device, "vkCmdSetAlphaToCoverageEnableEXT");
+    setColorBlendEnable = loadCommand<PFN_vkCmdSetColorBlendEnableEXT>(device, "vkCmdSetColorBlendEnableEXT");
+    setColorWriteMask = loadCommand<PFN_vkCmdSetColorWriteMaskEXT>(device, "vkCmdSetColorWriteMaskEXT");
+}
+
+ShaderObjectSet ShaderObjectBackend::get(const GraphicsPipelineDesc& desc) {
+    return create(desc, true);
+}
+
+ShaderObjectSet ShaderObjectBackend::build(const GraphicsPipelineDesc& desc) {
+    return create(desc, false);
+}
+
+ShaderObjectSet ShaderObjectBackend::create(const GraphicsPipelineDesc& desc, bool cached) {
+    PROFILE_ZONE("create shader objects");
+    // The same merge of all stages the pipeline layout is made from, so descriptor sets bound with it stay compatible
+    std::vector<const ShaderReflection*> reflections;
+    bool hasFragment = false;
+    for (const auto& stage : desc.stages) {
+        reflections.push_back(stage.reflection);
+        hasFragment = hasFragment || stage.reflection->entryPoints.at(stage.entryPointIndex).stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+    PipelineLayoutDesc layoutDesc = buildPipelineLayoutDesc(reflections);
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    for (const auto& bindings : layoutDesc.setBindings) {
+        setLayouts.push_back(layoutCache->getSetLayout(bindings));
+    }
+
+    ShaderObjectSet set;
+    std::vector<SpecializationData> specializations;
+    specializations.reserve(desc.stages.size()); // the create infos point into these
+    std::vector<VkShaderCreateInfoEXT> createInfos;
+    std::vector<std::vector<uint32_t>> keys;
+    std::vector<size_t> missing; // index into set.shaders of every stage that still has to be created
+
+    // Held across the create, so two threads asking for the same stage don't both compile it
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (cached) {
+        lock.lock();
+    }
+
+    for (const auto& stage : desc.stages) {
+        const SpirvEntryPoint& entryPoint = stage.reflection->entryPoints.at(stage.entryPointIndex);
+        set.stages.push_back(entryPoint.stage);
+        set.shaders.push_back(VK_NULL_HANDLE);
+
+        VkShaderStageFlags nextStage = 0;
+        if (entryPoint.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+            nextStage = hasFragment ? VK_SHADER_STAGE_FRAGMENT_BIT : 0;
+
+            // A pipeline takes this from pVertexInputState, with shader objects it is recorded in bind()
+            VertexInputDesc vertexInput = buildVertexInputDesc(entryPoint);
+            for (const auto& binding : vertexInput.bindings) {
+                VkVertexInputBindingDescription2EXT description{};
+                description.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+                description.binding = binding.binding;
+                description.stride = binding.stride;
+                description.inputRate = binding.inputRate;
+                description.divisor = 1;
+                set.vertexBindings.push_back(description);
+            }
+            for (const auto& attribute : vertexInput.attributes) {
+                VkVertexInputAttributeDescription2EXT description{};
+                description.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+                description.location = attribute.location;
+                description.binding = attribute.binding;
+                description.format = attribute.format;
+                description.offset = attribute.offset;
+                set.vertexAttributes.push_back(description);
+            }
+        }
+
+        specializations.push_back(buildSpecializationData(*stage.reflection, desc.specialization));
+        SpecializationData& specialization = specializations.back();
+
+        // Everything the compiled stage depends on: bytecode, entry point, next stage, specialization values and layout
+        const SpirvHash& hash = stage.module->hash();
+        std::vector<uint32_t> key = {static_cast<uint32_t>(hash.low), static_cast<uint32_t>(hash.low >> 32),
+                                     static_cast<uint32_t>(hash.high), static_cast<uint32_t>(hash.high >> 32),
+                                     stage.entryPointIndex, nextStage, static_cast<uint32_t>(specialization.entries.size())};
+        for (const auto& entry : specialization.entries) {
+            key.push_back(entry.constantID);
+            for (uint32_t i = 0; i < entry.size; i++) {
+                key.push_back(specialization.data[entry.offset + i]);
+            }
+        }
+        for (VkDescriptorSetLayout setLayout : setLayouts) {
+            appendHandle(key, setLayout);
+        }
+        for (const auto& range : layoutDesc.pushConstantRanges) {
+            key.insert(key.end(), {range.stageFlags, range.offset, range.size});
+        }
+
+        if (cached) {
+            auto it = shaders.find(key);
+            if (it != shaders.end()) {
+                std::vector<const void*>& owners = it->second.owners;
+                if (std::find(owners.begin(), owners.end(), desc.owner) == owners.end()) {
+                    owners.push_back(desc.owner);
+                }
+                set.shaders.back() = it->second.shader;
+                continue;
+            }
+        }
+
+        const SpirvBlob& code = stage.module->code();
+        VkShaderCreateInfoEXT createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+        createInfo.flags = 0; // unlinked, each stage stands on its own
+        createInfo.stage = entryPoint.stage;
+        createInfo.nextStage = nextStage;
+        createInfo.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        createInfo.codeSize = code.sizeBytes();
+        createInfo.pCode = code.words();
+        createInfo.pName = entryPoint.name.c_str();
+        createInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        createInfo.pSetLayouts = setLayouts.data();
+        createInfo.pushConstantRangeCount = static_cast<uint32_t>(layoutDesc.pushConstantRanges.size());
+        createInfo.pPushConstantRanges = layoutDesc.pushConstantRanges.data();
+        createInfo.pSpecializationInfo = specialization.get();
+        createInfos.push_back(createInfo);
+        keys.push_back(std::move(key));
+        missing.push_back(set.shaders.size() - 1);
+    }
+
+    if (createInfos.empty()) {
+        return set;
+    }
+
+    std::vector<VkShaderEXT> created(createInfos.size(), VK_NULL_HANDLE);
+    auto compileStart = std::chrono::steady_clock::now();
+    VkResult result = createShaders(device, static_cast<uint32_t>(createInfos.size()), createInfos.data(), nullptr, created.data());
+    if (result != VK_SUCCESS) {
+        // Stages that did compile come back valid even when another one failed
+        for (VkShaderEXT shader : created) {
+            if (shader != VK_NULL_HANDLE) {
+                destroyShader(device, shader, nullptr);
+            }
+        }
+        throw std::runtime_error("Failed to create shader objects for '" + desc.name + "'!");
+    }
+    double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+    for (size_t i = 0; i < created.size(); i++) {
+        set.shaders[missing[i]] = created[i];
+        if (cached) {
+            shaders.emplace(std::move(keys[i]), CachedShader{created[i], {desc.owner}});
+        }
+    }
+
+    if (cached) {
+        std::ostringstream message;
+        message << "\tShader objects '" << desc.name << "' (" << desc.specialization.toString() << ") created in " << compileMs
+                << " ms, " << created.size() << " of " << set.shaders.size() << " stages compiled\n";
+        std::cout << message.str() << std::flush;
+    }
+    return set;
+}
+
+void ShaderObjectBackend::release(const ShaderObjectSet& set) {
+    for (VkShaderEXT shader : set.shaders) {
+        destroyShader(device, shader, nullptr);
+    }
+}
+
+void ShaderObjectBackend::bind(VkCommandBuffer commandBuffer, const ShaderObjectSet& set, const RasterState& raster) const {
+    bindShaders(commandBuffer, static_cast<uint32_t>(set.stages.size()), set.stages.data(), set.shaders.data());
+
+    // Vertex input and input assembly
+    setVertexInput(commandBuffer, static_cast<uint32_t>(set.vertexBindings.size()), set.vertexBindings.data(),
+                   static_cast<uint32_t>(set.vertexAttributes.size()), set.vertexAttributes.data());
+    vkCmdSetPrimitiveTopology(commandBuffer, raster.topology);
+    vkCmdSetPrimitiveRestartEnable(commandBuffer, raster.primitiveRestart ? VK_TRUE : VK_FALSE);
+
+    // Rasterization
+    vkCmdSetRasterizerDiscardEnable(commandBuffer, VK_FALSE);
+    setPolygonMode(commandBuffer, raster.polygonMode);
+    vkCmdSetCullMode(commandBuffer, raster.cullMode);
+    vkCmdSetFrontFace(commandBuffer, raster.frontFace);
+    vkCmdSetDepthBiasEnable(commandBuffer, VK_FALSE);
+    vkCmdSetLineWidth(commandBuffer, 1.0f);
+
+    // Depth and stencil
+    vkCmdSetDepthTestEnable(commandBuffer, raster.depthTest ? VK_TRUE : VK_FALSE);
+    vkCmdSetDepthWriteEnable(commandBuffer, raster.depthWrite ? VK_TRUE : VK_FALSE);
+    vkCmdSetDepthCompareOp(commandBuffer, raster.depthCompareOp);
+    vkCmdSetStencilTestEnable(commandBuffer, VK_FALSE);
+
+    // One sample, every sample covered, like the multisample state of the pipelines
+    VkSampleMask sampleMask = 0xFFFFFFFF;
+    setRasterizationSamples(commandBuffer, VK_SAMPLE_COUNT_1_BIT);
+    setSampleMask(commandBuffer, VK_SAMPLE_COUNT_1_BIT, &sampleMask);
+    setAlphaToCoverageEnable(commandBuffer, VK_FALSE);
+
+    // No blending, the fragment color is written straight to the one color attachment
+    VkBool32 blendEnable = VK_FALSE;
+    VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    setColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+    setColorWriteMask(commandBuffer, 0, 1, &writeMask);
+}
+
+void ShaderObjectBackend::releaseOwner(const void* owner) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = shaders.begin(); it != shaders.end();) {
+        std::vector<const void*>& owners = it->second.owners;
+        owners.erase(std::remove(owners.begin(), owners.end(), owner), owners.end());
+        if (owners.empty()) {
+            destroyShader(device, it->second.shader, nullptr);
+            it = shaders.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ShaderObjectBackend::shaderCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return shaders.size();
+}
+
+void ShaderObjectBackend::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : shaders) {
+        destroyShader(device, entry.second.shader, nullptr);
+    }
+    shaders.clear();
+}
+
+size_t ShaderObjectBackend::KeyHash::operator()(const std::vector<uint32_t>& key) const {
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t word : key) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
@@ -0,0 +1,186 @@
+#include "ShaderWatcher.h"
+#include "Config.h"
+#include "Profiler.h"
+
+#include <poll.h>
+#include <spawn.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+
+extern char** environ;
+
+// How long to keep collecting events after the first one, editors often write a file in several steps
+static const int DEBOUNCE_MS = 50;
+
+std::string shaderSourceDirectory() {
+#ifdef VULK_SHADER_SOURCE_DIR
+    return envString("VULK_SHADER_SOURCE_DIR", VULK_SHADER_SOURCE_DIR);
+#else
+    return envString("VULK_SHADER_SOURCE_DIR", executableDirectory() + "/../shaders");
+#endif
+}
+
+// shader.vert -> vert.spv, the same names compile.sh and the build produce. Empty for files that aren't shader sources
+static std::string spirvNameFor(const std::string& sourceName) {
+    static const std::set<std::string> stages = {"vert", "frag", "comp", "geom", "tesc", "tese"};
+
+    size_t dot = sourceName.find_last_of('.');
+    if (dot == std::string::npos || sourceName[0] == '.') {
+        return "";
+    }
+    std::string extension = sourceName.substr(dot + 1);
+    return stages.count(extension) ? extension + ".spv" : "";
+}
+
+void ShaderWatcher::start(const std::string& sourceDirectory, const std::string& glslc) {
+    directory = sourceDirectory;
+    compiler = glslc;
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        throw std::runtime_error(std::string("failed to initialize inotify: ") + strerror(errno));
+    }
+    // IN_MOVED_TO catches editors that save by writing a temp file and renaming it over the original
+    if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        int error = errno;
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        throw std::runtime_error("failed to watch shader directory " + directory + ": " + strerror(error));
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        int error = errno;
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        throw std::runtime_error(std::string("failed to create the shader watcher wake event: ") + strerror(error));
+    }
+    watcherThread = std::thread(&ShaderWatcher::watchLoop, this);
+}
+
+void ShaderWatcher::stop() {
+    if (!watcherThread.joinable()) {
+        return;
+    }
+
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "failed to wake the shader watcher: " << strerror(errno) << std::endl;
+    }
+    watcherThread.join();
+
+    ::close(wakeFd);
+    ::close(inotifyFd);
+    wakeFd = -1;
+    inotifyFd = -1;
+}
+
+std::vector<ShaderWatcher::Update> ShaderWatcher::takeUpdates() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Update> taken = std::move(updates);
+    updates.clear();
+    return taken;
+}
+
+void ShaderWatcher::watchLoop() {
+    Profiler::setThreadName("shader watcher");
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+
+    for (;;) {
+        std::set<std::string> changed;
+        int timeout = -1;
+
+        // Block until the first event, then keep draining until the directory has been quiet for DEBOUNCE_MS
+        for (;;) {
+            int ready = poll(fds, 2, timeout);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready < 0 || (fds[1].revents & POLLIN)) {
+                return;
+            }
+            if (ready == 0) {
+                break;
+            }
+
+            ssize_t length;
+            while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                for (char* cursor = buffer; cursor < buffer + length;) {
+                    auto* event = reinterpret_cast<inotify_event*>(cursor);
+                    if (event->len > 0 && !spirvNameFor(event->name).empty()) {
+                        changed.insert(event->name);
+                    }
+                    cursor += sizeof(inotify_event) + event->len;
+                }
+            }
+            timeout = DEBOUNCE_MS;
+        }
+
+        for (const std::string& sourceName : changed) {
+            compile(sourceName);
+        }
+    }
+}
+
+void ShaderWatcher::compile(const std::string& sourceName) {
+    PROFILE_ZONE("compile shader");
+    std::string spirvName = spirvNameFor(sourceName);
+    std::string source = directory + "/" + sourceName;
+    std::string output = envString("TMPDIR", "/tmp") + "/vulk_" + std::to_string(getpid()) + "_" + spirvName;
+
+    auto compileStart = std::chrono::steady_clock::now();
+
+    // posix_spawn instead of system(): no shell, so paths with spaces or quotes need no escaping
+    std::vector<std::string> args = {compiler, source, "-o", output};
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int status = 0;
+    int error = posix_spawnp(&pid, compiler.c_str(), nullptr, nullptr, argv.data(), environ);
+    if (error != 0) {
+        std::cerr << "Hot reload: failed to run " << compiler << ": " << strerror(error) << std::endl;
+        return;
+    }
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        // glslc already printed the errors
+        std::cerr << "Hot reload: " << sourceName << " failed to compile, keeping the previous module" << std::endl;
+        return;
+    }
+
+    try {
+        // The mapping stays valid after the file is unlinked, so nothing is left behind in TMPDIR
+        SpirvBlob code(output);
+        unlink(output.c_str());
+
+        double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+        std::cout << "Hot reload: compiled " << sourceName << " in " << compileMs << " ms" << std::endl;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = updates.begin(); it != updates.end(); ++it) {
+            if (it->name == spirvName) {
+                updates.erase(it);
+                break;
+            }
+        }
+        updates.push_back({spirvName, std::move(code)});
+    } catch (const std::exception& e) {
+        unlink(output.c_str());
+        std::cerr << "Hot reload: " << e.what() << std::endl;
+    }
+}
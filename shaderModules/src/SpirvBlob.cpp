@@ -0,0 +1,144 @@
+#include "SpirvBlob.h"
+#include "Config.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+SpirvBlob::SpirvBlob(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open shader file " + filename + ": " + strerror(errno));
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("failed to stat shader file " + filename + ": " + strerror(error));
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size % sizeof(uint32_t) != 0 || size < HEADER_WORDS * sizeof(uint32_t)) {
+        ::close(fd);
+        throw std::runtime_error(filename + " is not a SPIR-V module (size " + std::to_string(size) + " is not a whole number of words)");
+    }
+
+    // MAP_PRIVATE + PROT_READ: the pages come straight from the page cache and are never written
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("failed to map shader file " + filename + ": " + strerror(error));
+    }
+
+    data = static_cast<const uint32_t*>(mapping);
+    count = size / sizeof(uint32_t);
+    mappedBytes = size;
+
+    try {
+        validate(data, count, filename);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+SpirvBlob SpirvBlob::view(const uint32_t* words, size_t wordCount, const std::string& name) {
+    validate(words, wordCount, name);
+
+    SpirvBlob blob;
+    blob.data = words;
+    blob.count = wordCount;
+    return blob;
+}
+
+SpirvBlob::~SpirvBlob() {
+    release();
+}
+
+SpirvBlob::SpirvBlob(SpirvBlob&& other) noexcept
+    : data(other.data), count(other.count), mappedBytes(other.mappedBytes) {
+    other.data = nullptr;
+    other.count = 0;
+    other.mappedBytes = 0;
+}
+
+SpirvBlob& SpirvBlob::operator=(SpirvBlob&& other) noexcept {
+    if (this != &other) {
+        release();
+        data = other.data;
+        count = other.count;
+        mappedBytes = other.mappedBytes;
+        other.data = nullptr;
+        other.count = 0;
+        other.mappedBytes = 0;
+    }
+    return *this;
+}
+
+void SpirvBlob::release() {
+    if (mappedBytes != 0) {
+        munmap(const_cast<uint32_t*>(data), mappedBytes);
+    }
+    data = nullptr;
+    count = 0;
+    mappedBytes = 0;
+}
+
+void SpirvBlob::validate(const uint32_t* words, size_t wordCount, const std::string& name) {
+    if (words == nullptr || wordCount < HEADER_WORDS) {
+        throw std::runtime_error(name + " is too small to be a SPIR-V module");
+    }
+    if (words[0] != MAGIC) {
+        // A byte-swapped magic number means the module was written on a machine with the other endianness
+        if (words[0] == __builtin_bswap32(MAGIC)) {
+            throw std::runtime_error(name + " is a SPIR-V module with the wrong endianness");
+        }
+        throw std::runtime_error(name + " does not start with the SPIR-V magic number");
+    }
+}
+
+std::string executableDirectory() {
+    char buffer[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+    if (length <= 0) {
+        return ".";
+    }
+    buffer[length] = '\0';
+
+    std::string path(buffer);
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+static bool fileExists(const std::string& path) {
+    return access(path.c_str(), R_OK) == 0;
+}
+
+std::string resolveShaderPath(const std::string& name) {
+    if (!name.empty() && name[0] == '/') {
+        return name;
+    }
+
+    std::string overrideDir = envString("VULK_SHADER_DIR");
+    if (!overrideDir.empty() && fileExists(overrideDir + "/" + name)) {
+        return overrideDir + "/" + name;
+    }
+
+    // Resolved once, the executable does not move while we are running
+    static const std::string exeDir = executableDirectory();
+    for (const std::string& candidate : {exeDir + "/shaders/" + name, exeDir + "/../shaders/" + name}) {
+        if (fileExists(candidate)) {
+            return candidate;
+        }
+    }
+
+    throw std::runtime_error("could not find shader " + name + " next to " + exeDir + " (set VULK_SHADER_DIR to override)");
+}
@@ -0,0 +1,667 @@
+#include "SpirvReflect.h"
+#include "SpirvBlob.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+// The subset of the SPIR-V grammar reflection cares about (values from the SPIR-V 1.6 spec)
+enum SpvOp : uint32_t {
+    OpName = 5,
+    OpMemberName = 6,
+    OpEntryPoint = 15,
+    OpTypeVoid = 19,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstantTrue = 48,
+    OpSpecConstantFalse = 49,
+    OpSpecConstant = 50,
+    OpFunction = 54,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum SpvDecoration : uint32_t {
+    DecorationSpecId = 1,
+    DecorationBlock = 2,
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationMatrixStride = 7,
+    DecorationBuiltIn = 11,
+    DecorationLocation = 30,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+};
+
+enum SpvStorageClass : uint32_t {
+    StorageClassUniformConstant = 0,
+    StorageClassInput = 1,
+    StorageClassUniform = 2,
+    StorageClassOutput = 3,
+    StorageClassPushConstant = 9,
+    StorageClassStorageBuffer = 12,
+};
+
+enum SpvDim : uint32_t {
+    DimBuffer = 5,
+    DimSubpassData = 6,
+};
+
+struct MemberInfo {
+    std::string name;
+    uint32_t offset = 0;
+    uint32_t matrixStride = 0;
+    bool hasOffset = false;
+    bool builtIn = false;
+};
+
+// Everything we learned about one result id
+struct IdInfo {
+    uint32_t opcode = 0;
+    uint32_t typeId = 0; // result type, for constants and variables
+    std::vector<uint32_t> operands; // words after the result id
+    std::string name;
+    std::vector<MemberInfo> members;
+
+    bool hasLocation = false;
+    bool hasBinding = false;
+    bool hasSet = false;
+    bool hasSpecId = false;
+    bool builtIn = false;
+    bool block = false;
+    bool bufferBlock = false;
+    uint32_t location = 0;
+    uint32_t binding = 0;
+    uint32_t set = 0;
+    uint32_t specId = 0;
+    uint32_t arrayStride = 0;
+};
+
+// Type declarations can only nest this deep, anything deeper is a malformed module referencing itself
+static const uint32_t MAX_TYPE_DEPTH = 64;
+
+// Literal strings are nul-terminated and packed little-endian into as many words as needed
+static std::string readString(const uint32_t* words, size_t available, size_t& consumed) {
+    std::string result;
+    for (consumed = 0; consumed < available; consumed++) {
+        uint32_t word = words[consumed];
+        for (int byte = 0; byte < 4; byte++) {
+            char c = static_cast<char>((word >> (byte * 8)) & 0xFF);
+            if (c == '\0') {
+                consumed++;
+                return result;
+            }
+            result += c;
+        }
+    }
+    throw std::runtime_error("SPIR-V: unterminated literal string");
+}
+
+static VkShaderStageFlagBits stageFromExecutionModel(uint32_t model) {
+    switch (model) {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+        default: throw std::runtime_error("SPIR-V: unsupported execution model " + std::to_string(model));
+    }
+}
+
+class Reflector {
+public:
+    Reflector(const uint32_t* words, size_t wordCount) : words(words), wordCount(wordCount) {}
+
+    ShaderReflection run() {
+        SpirvBlob::validate(words, wordCount, "SPIR-V module");
+
+        // Every id is declared by an instruction of at least two words, a bigger bound is a corrupt header
+        uint32_t bound = words[3];
+        if (bound > wordCount) {
+            throw std::runtime_error("SPIR-V: id bound " + std::to_string(bound) + " is larger than the module");
+        }
+        ids.resize(bound);
+
+        parse();
+
+        ShaderReflection reflection;
+        for (auto& entry : entryPoints) {
+            reflection.stages |= entry.first.stage;
+            collectInterface(entry.first, entry.second);
+            reflection.entryPoints.push_back(std::move(entry.first));
+        }
+        collectResources(reflection);
+        collectSpecConstants(reflection);
+        return reflection;
+    }
+
+private:
+    IdInfo& at(uint32_t id) {
+        if (id >= ids.size()) {
+            throw std::runtime_error("SPIR-V: id " + std::to_string(id) + " is out of bounds");
+        }
+        return ids[id];
+    }
+
+    // Operand index of a type or value, the instruction may have been shorter than its opcode needs
+    static uint32_t operand(const IdInfo& info, size_t index) {
+        if (index >= info.operands.size()) {
+            throw std::runtime_error("SPIR-V: opcode " + std::to_string(info.opcode) + " is missing operand " + std::to_string(index));
+        }
+        return info.operands[index];
+    }
+
+    static void requireLength(uint32_t opcode, uint32_t length, uint32_t minimum, size_t pos) {
+        if (length < minimum) {
+            throw std::runtime_error("SPIR-V: opcode " + std::to_string(opcode) + " at word " + std::to_string(pos) +
+                                     " has " + std::to_string(length) + " words, needs at least " + std::to_string(minimum));
+        }
+    }
+
+    void parse() {
+        size_t pos = SpirvBlob::HEADER_WORDS;
+        while (pos < wordCount) {
+            uint32_t opcode = words[pos] & 0xFFFF;
+            uint32_t length = words[pos] >> 16;
+            if (length == 0 || pos + length > wordCount) {
+                throw std::runtime_error("SPIR-V: bad instruction length at word " + std::to_string(pos));
+            }
+            const uint32_t* inst = words + pos;
+
+            // Everything we need is declared before the first function body
+            if (opcode == OpFunction) {
+                break;
+            }
+
+            switch (opcode) {
+                case OpName: {
+                    requireLength(opcode, length, 3, pos);
+                    size_t consumed;
+                    at(inst[1]).name = readString(inst + 2, length - 2, consumed);
+                    break;
+                }
+                case OpMemberName: {
+                    requireLength(opcode, length, 4, pos);
+                    size_t consumed;
+                    member(inst[1], inst[2]).name = readString(inst + 3, length - 3, consumed);
+                    break;
+                }
+                case OpEntryPoint: {
+                    requireLength(opcode, length, 4, pos);
+                    SpirvEntryPoint entry;
+                    entry.stage = stageFromExecutionModel(inst[1]);
+                    size_t consumed;
+                    entry.name = readString(inst + 3, length - 3, consumed);
+                    std::vector<uint32_t> interfaceIds(inst + 3 + consumed, inst + length);
+                    entryPoints.emplace_back(std::move(entry), std::move(interfaceIds));
+                    break;
+                }
+                case OpTypeVoid:
+                case OpTypeBool:
+                case OpTypeInt:
+                case OpTypeFloat:
+                case OpTypeVector:
+                case OpTypeMatrix:
+                case OpTypeImage:
+                case OpTypeSampler:
+                case OpTypeSampledImage:
+                case OpTypeArray:
+                case OpTypeRuntimeArray:
+                case OpTypeStruct:
+                case OpTypePointer:
+                case OpTypeAccelerationStructureKHR: {
+                    requireLength(opcode, length, 2, pos);
+                    IdInfo& info = at(inst[1]);
+                    info.opcode = opcode;
+                    info.operands.assign(inst + 2, inst + length);
+                    break;
+                }
+                case OpConstant:
+                case OpSpecConstantTrue:
+                case OpSpecConstantFalse:
+                case OpSpecConstant:
+                case OpVariable: {
+                    requireLength(opcode, length, 3, pos);
+                    IdInfo& info = at(inst[2]);
+                    info.opcode = opcode;
+                    info.typeId = inst[1];
+                    info.operands.assign(inst + 3, inst + length);
+                    break;
+                }
+                case OpDecorate:
+                    requireLength(opcode, length, 3, pos);
+                    decorate(at(inst[1]), inst[2], length > 3 ? inst[3] : 0);
+                    break;
+                case OpMemberDecorate:
+                    requireLength(opcode, length, 4, pos);
+                    memberDecorate(member(inst[1], inst[2]), inst[3], length > 4 ? inst[4] : 0);
+                    break;
+                default:
+                    break;
+            }
+
+            pos += length;
+        }
+    }
+
+    MemberInfo& member(uint32_t structId, uint32_t index) {
+        IdInfo& info = at(structId);
+        // A struct can't have more members than the module has words, this keeps a corrupt index from allocating gigabytes
+        if (index >= wordCount) {
+            throw std::runtime_error("SPIR-V: member index " + std::to_string(index) + " of id " + std::to_string(structId) + " is out of bounds");
+        }
+        if (index >= info.members.size()) {
+            info.members.resize(index + 1);
+        }
+        return info.members[index];
+    }
+
+    static void decorate(IdInfo& info, uint32_t decoration, uint32_t value) {
+        switch (decoration) {
+            case DecorationSpecId: info.hasSpecId = true; info.specId = value; break;
+            case DecorationBlock: info.block = true; break;
+            case DecorationBufferBlock: info.bufferBlock = true; break;
+            case DecorationArrayStride: info.arrayStride = value; break;
+            case DecorationBuiltIn: info.builtIn = true; break;
+            case DecorationLocation: info.hasLocation = true; info.location = value; break;
+            case DecorationBinding: info.hasBinding = true; info.binding = value; break;
+            case DecorationDescriptorSet: info.hasSet = true; info.set = value; break;
+            default: break;
+        }
+    }
+
+    static void memberDecorate(MemberInfo& info, uint32_t decoration, uint32_t value) {
+        switch (decoration) {
+            case DecorationOffset: info.hasOffset = true; info.offset = value; break;
+            case DecorationMatrixStride: info.matrixStride = value; break;
+            case DecorationBuiltIn: info.builtIn = true; break;
+            default: break;
+        }
+    }
+
+    // Value of an OpConstant used as an array length
+    uint32_t constantValue(uint32_t id) {
+        const IdInfo& info = at(id);
+        if ((info.opcode != OpConstant && info.opcode != OpSpecConstant) || info.operands.empty()) {
+            throw std::runtime_error("SPIR-V: array length is not a constant");
+        }
+        return info.operands[0];
+    }
+
+    uint32_t typeSize(uint32_t typeId, uint32_t matrixStride = 0, uint32_t depth = 0) {
+        if (depth > MAX_TYPE_DEPTH) {
+            throw std::runtime_error("SPIR-V: type " + std::to_string(typeId) + " nests too deep");
+        }
+        const IdInfo& type = at(typeId);
+        switch (type.opcode) {
+            case OpTypeBool:
+                return 4;
+            case OpTypeInt:
+            case OpTypeFloat:
+                return operand(type, 0) / 8;
+            case OpTypeVector:
+                return operand(type, 1) * typeSize(operand(type, 0), 0, depth + 1);
+            case OpTypeMatrix:
+                return operand(type, 1) * (matrixStride != 0 ? matrixStride : typeSize(operand(type, 0), 0, depth + 1));
+            case OpTypeArray: {
+                uint32_t stride = type.arrayStride != 0 ? type.arrayStride : typeSize(operand(type, 0), 0, depth + 1);
+                return constantValue(operand(type, 1)) * stride;
+            }
+            case OpTypeRuntimeArray:
+                return 0;
+            case OpTypeStruct: {
+                uint32_t size = 0;
+                for (size_t i = 0; i < type.operands.size(); i++) {
+                    const MemberInfo* info = i < type.members.size() ? &type.members[i] : nullptr;
+                    uint32_t memberSize = typeSize(type.operands[i], info ? info->matrixStride : 0, depth + 1);
+                    uint32_t offset = (info && info->hasOffset) ? info->offset : size;
+                    size = std::max(size, offset + memberSize);
+                }
+                return size;
+            }
+            case OpTypePointer:
+                return 8; // physical storage buffer pointer
+            default:
+                return 0;
+        }
+    }
+
+    // Format of a scalar or vector type, UNDEFINED for anything that can't be a vertex attribute
+    VkFormat typeFormat(uint32_t typeId) {
+        const IdInfo& type = at(typeId);
+        uint32_t components = 1;
+        const IdInfo* scalar = &type;
+        if (type.opcode == OpTypeVector) {
+            components = operand(type, 1);
+            scalar = &at(operand(type, 0));
+        }
+        if (components < 1 || components > 4) {
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        static const VkFormat float32[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+        static const VkFormat sint32[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+        static const VkFormat uint32[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+        static const VkFormat float64[] = {VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT, VK_FORMAT_R64G64B64_SFLOAT, VK_FORMAT_R64G64B64A64_SFLOAT};
+
+        if (scalar->opcode == OpTypeFloat && operand(*scalar, 0) == 32) return float32[components - 1];
+        if (scalar->opcode == OpTypeFloat && operand(*scalar, 0) == 64) return float64[components - 1];
+        if (scalar->opcode == OpTypeInt && operand(*scalar, 0) == 32) {
+            return operand(*scalar, 1) ? sint32[components - 1] : uint32[components - 1];
+        }
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    // Splits one Input/Output variable into per-location entries (matrices and arrays take one location per column/element)
+    void addInterfaceVariable(std::vector<SpirvInterfaceVariable>& out, const IdInfo& variable) {
+        uint32_t typeId = pointee(variable);
+        const IdInfo& type = at(typeId);
+
+        uint32_t elementType = typeId;
+        uint32_t elements = 1;
+        if (type.opcode == OpTypeMatrix) {
+            elementType = operand(type, 0);
+            elements = operand(type, 1);
+        } else if (type.opcode == OpTypeArray) {
+            elementType = operand(type, 0);
+            elements = constantValue(operand(type, 1));
+        }
+        // Locations are 32-bit, a huge count is a corrupt length rather than a real interface
+        if (elements > wordCount) {
+            throw std::runtime_error("SPIR-V: interface variable '" + variable.name + "' has too many elements");
+        }
+
+        for (uint32_t i = 0; i < elements; i++) {
+            SpirvInterfaceVariable entry;
+            entry.name = elements > 1 ? variable.name + "[" + std::to_string(i) + "]" : variable.name;
+            entry.location = variable.location + i;
+            entry.format = typeFormat(elementType);
+            entry.sizeBytes = typeSize(elementType);
+            out.push_back(entry);
+        }
+    }
+
+    // The type a variable points to, through its OpTypePointer (storage class, type)
+    uint32_t pointee(const IdInfo& variable) {
+        const IdInfo& pointer = at(variable.typeId);
+        if (pointer.opcode != OpTypePointer) {
+            throw std::runtime_error("SPIR-V: variable '" + variable.name + "' does not have a pointer type");
+        }
+        return operand(pointer, 1);
+    }
+
+    void collectInterface(SpirvEntryPoint& entry, const std::vector<uint32_t>& interfaceIds) {
+        for (uint32_t id : interfaceIds) {
+            const IdInfo& variable = at(id);
+            // Built-ins (gl_Position, gl_VertexIndex, ...) and gl_PerVertex blocks have no location
+            if (variable.opcode != OpVariable || variable.builtIn || !variable.hasLocation) {
+                continue;
+            }
+            uint32_t storageClass = operand(variable, 0);
+            if (storageClass == StorageClassInput) {
+                addInterfaceVariable(entry.inputs, variable);
+            } else if (storageClass == StorageClassOutput) {
+                addInterfaceVariable(entry.outputs, variable);
+            }
+        }
+
+        auto byLocation = [](const SpirvInterfaceVariable& a, const SpirvInterfaceVariable& b) { return a.location < b.location; };
+        std::sort(entry.inputs.begin(), entry.inputs.end(), byLocation);
+        std::sort(entry.outputs.begin(), entry.outputs.end(), byLocation);
+    }
+
+    VkDescriptorType descriptorType(uint32_t storageClass, const IdInfo& type) {
+        switch (storageClass) {
+            case StorageClassStorageBuffer:
+                return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            case StorageClassUniform:
+                // Pre-1.3 SPIR-V marks storage buffers as Uniform + BufferBlock
+                return type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            case StorageClassUniformConstant:
+                switch (type.opcode) {
+                    case OpTypeSampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+                    case OpTypeSampledImage: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                    case OpTypeAccelerationStructureKHR: return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+                    case OpTypeImage: {
+                        // operands: sampled type, dim, depth, arrayed, multisampled, sampled (1 = sampled, 2 = storage), format
+                        uint32_t dim = operand(type, 1);
+                        uint32_t sampled = operand(type, 5);
+                        if (dim == DimSubpassData) return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                        if (dim == DimBuffer) {
+                            return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                        }
+                        return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                    }
+                    default: break;
+                }
+                break;
+            default:
+                break;
+        }
+        throw std::runtime_error("SPIR-V: unsupported descriptor type");
+    }
+
+    // Descriptor bindings and push constant blocks are module-wide: every stage of the module is assumed to use them
+    void collectResources(ShaderReflection& reflection) {
+        for (uint32_t id = 0; id < ids.size(); id++) {
+            const IdInfo& variable = ids[id];
+            if (variable.opcode != OpVariable) {
+                continue;
+            }
+            uint32_t storageClass = operand(variable, 0);
+            uint32_t typeId = pointee(variable);
+
+            if (storageClass == StorageClassPushConstant) {
+                const IdInfo& block = at(typeId);
+                SpirvPushConstantBlock pushConstant;
+                pushConstant.name = variable.name.empty() ? block.name : variable.name;
+                uint32_t firstOffset = UINT32_MAX;
+                for (const auto& member : block.members) {
+                    if (member.hasOffset) {
+                        firstOffset = std::min(firstOffset, member.offset);
+                    }
+                }
+                pushConstant.offset = firstOffset == UINT32_MAX ? 0 : firstOffset;
+                pushConstant.size = typeSize(typeId) - pushConstant.offset;
+                reflection.pushConstants.push_back(pushConstant);
+                continue;
+            }
+
+            if (storageClass != StorageClassUniform && storageClass != StorageClassUniformConstant &&
+                storageClass != StorageClassStorageBuffer) {
+                continue;
+            }
+            if (!variable.hasBinding) {
+                continue;
+            }
+
+            // Strip arrays of descriptors down to the descriptor type
+            uint32_t count = 1;
+            const IdInfo* type = &at(typeId);
+            for (uint32_t depth = 0; type->opcode == OpTypeArray || type->opcode == OpTypeRuntimeArray; depth++) {
+                if (depth > MAX_TYPE_DEPTH) {
+                    throw std::runtime_error("SPIR-V: descriptor array type nests too deep");
+                }
+                count = type->opcode == OpTypeArray ? count * constantValue(operand(*type, 1)) : 0;
+                type = &at(operand(*type, 0));
+            }
+
+            SpirvDescriptorBinding binding;
+            binding.name = variable.name.empty() ? type->name : variable.name;
+            binding.set = variable.hasSet ? variable.set : 0;
+            binding.binding = variable.binding;
+            binding.type = descriptorType(storageClass, *type);
+            binding.count = count;
+            reflection.descriptorBindings.push_back(binding);
+        }
+
+        std::sort(reflection.descriptorBindings.begin(), reflection.descriptorBindings.end(),
+            [](const SpirvDescriptorBinding& a, const SpirvDescriptorBinding& b) {
+                return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+            });
+    }
+
+    void collectSpecConstants(ShaderReflection& reflection) {
+        for (uint32_t id = 0; id < ids.size(); id++) {
+            const IdInfo& constant = ids[id];
+            if (!constant.hasSpecId) {
+                continue;
+            }
+
+            SpirvSpecConstant spec;
+            spec.name = constant.name;
+            spec.constantId = constant.specId;
+
+            if (constant.opcode == OpSpecConstantTrue || constant.opcode == OpSpecConstantFalse) {
+                spec.kind = SpirvSpecConstant::Kind::Bool;
+                spec.size = sizeof(VkBool32);
+                spec.defaultValue = constant.opcode == OpSpecConstantTrue ? 1 : 0;
+            } else if (constant.opcode == OpSpecConstant) {
+                const IdInfo& type = at(constant.typeId);
+                if (type.opcode != OpTypeInt && type.opcode != OpTypeFloat) {
+                    throw std::runtime_error("SPIR-V: specialization constant " + std::to_string(constant.specId) + " is not a scalar");
+                }
+                spec.size = operand(type, 0) / 8;
+                if (type.opcode == OpTypeFloat) {
+                    spec.kind = SpirvSpecConstant::Kind::Float;
+                } else {
+                    spec.kind = operand(type, 1) ? SpirvSpecConstant::Kind::Int : SpirvSpecConstant::Kind::UInt;
+                }
+                spec.defaultValue = constant.operands.empty() ? 0 : constant.operands[0];
+                if (constant.operands.size() > 1) {
+                    spec.defaultValue |= static_cast<uint64_t>(constant.operands[1]) << 32;
+                }
+            } else {
+                continue;
+            }
+
+            reflection.specConstants.push_back(spec);
+        }
+
+        std::sort(reflection.specConstants.begin(), reflection.specConstants.end(),
+            [](const SpirvSpecConstant& a, const SpirvSpecConstant& b) { return a.constantId < b.constantId; });
+    }
+
+    const uint32_t* words;
+    size_t wordCount;
+    std::vector<IdInfo> ids;
+    std::vector<std::pair<SpirvEntryPoint, std::vector<uint32_t>>> entryPoints; // with their interface ids
+};
+
+ShaderReflection reflectSpirv(const uint32_t* words, size_t wordCount) {
+    return Reflector(words, wordCount).run();
+}
+
+PipelineLayoutDesc buildPipelineLayoutDesc(const std::vector<const ShaderReflection*>& stages) {
+    // (set, binding) -> merged binding
+    std::map<std::pair<uint32_t, uint32_t>, VkDescriptorSetLayoutBinding> bindings;
+
+    uint32_t pushBegin = UINT32_MAX;
+    uint32_t pushEnd = 0;
+    VkShaderStageFlags pushStages = 0;
+
+    for (const ShaderReflection* stage : stages) {
+        for (const auto& resource : stage->descriptorBindings) {
+            if (resource.count == 0) {
+                throw std::runtime_error("Unsized descriptor array '" + resource.name + "' needs descriptor indexing, which is not supported yet");
+            }
+
+            auto key = std::make_pair(resource.set, resource.binding);
+            auto it = bindings.find(key);
+            if (it == bindings.end()) {
+                VkDescriptorSetLayoutBinding binding{};
+                binding.binding = resource.binding;
+                binding.descriptorType = resource.type;
+                binding.descriptorCount = resource.count;
+                binding.stageFlags = stage->stages;
+                binding.pImmutableSamplers = nullptr;
+                bindings.emplace(key, binding);
+            } else if (it->second.descriptorType != resource.type || it->second.descriptorCount != resource.count) {
+                throw std::runtime_error("Stages disagree on set " + std::to_string(resource.set) +
+                                         " binding " + std::to_string(resource.binding) + " ('" + resource.name + "')");
+            } else {
+                it->second.stageFlags |= stage->stages;
+            }
+        }
+
+        for (const auto& pushConstant : stage->pushConstants) {
+            pushBegin = std::min(pushBegin, pushConstant.offset);
+            pushEnd = std::max(pushEnd, pushConstant.offset + pushConstant.size);
+            pushStages |= stage->stages;
+        }
+    }
+
+    PipelineLayoutDesc desc;
+    for (const auto& entry : bindings) {
+        uint32_t set = entry.first.first;
+        if (set >= desc.setBindings.size()) {
+            desc.setBindings.resize(set + 1);
+        }
+        desc.setBindings[set].push_back(entry.second);
+    }
+
+    if (pushStages != 0 && pushEnd > pushBegin) {
+        VkPushConstantRange range{};
+        range.stageFlags = pushStages;
+        range.offset = pushBegin;
+        range.size = pushEnd - pushBegin;
+        desc.pushConstantRanges.push_back(range);
+    }
+
+    return desc;
+}
+
+VertexInputDesc buildVertexInputDesc(const SpirvEntryPoint& vertexEntryPoint) {
+    VertexInputDesc desc;
+    if (vertexEntryPoint.inputs.empty()) {
+        return desc;
+    }
+
+    uint32_t offset = 0;
+    for (const auto& input : vertexEntryPoint.inputs) {
+        if (input.format == VK_FORMAT_UNDEFINED) {
+            throw std::runtime_error("Vertex input '" + input.name + "' has a type that can't be fed from a vertex buffer");
+        }
+        VkVertexInputAttributeDescription attribute{};
+        attribute.location = input.location;
+        attribute.binding = 0;
+        attribute.format = input.format;
+        attribute.offset = offset;
+        desc.attributes.push_back(attribute);
+        offset += input.sizeBytes;
+    }
+
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = offset;
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    desc.bindings.push_back(binding);
+
+    return desc;
+}
+
+VkPipelineVertexInputStateCreateInfo VertexInputDesc::createInfo() const {
+    VkPipelineVertexInputStateCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    info.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+    info.pVertexBindingDescriptions = bindings.data();
+    info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+    info.pVertexAttributeDescriptions = attributes.data();
+    return info;
+}
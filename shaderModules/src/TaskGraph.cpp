@@ -0,0 +1,105 @@
+#include "TaskGraph.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+static double millisecondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+void TaskGraph::start(uint32_t workerCount) {
+    origin = std::chrono::steady_clock::now();
+    pool.start(workerCount, "startup worker");
+}
+
+TaskGraph::TaskId TaskGraph::add(const char* name, std::function<void()> work, std::vector<TaskId> dependencies) {
+    if (pool.size() == 0) {
+        return runHere(name, std::move(work), std::move(dependencies));
+    }
+
+    auto task = std::make_shared<Task>();
+    task->name = name;
+
+    std::vector<std::shared_future<void>> waitFor;
+    for (TaskId dependency : dependencies) {
+        waitFor.push_back(tasks.at(dependency)->done);
+    }
+
+    TaskId id = tasks.size();
+    tasks.push_back(task);
+    task->done = pool.submit([this, task, waitFor, work = std::move(work)]() {
+        for (const auto& dependency : waitFor) {
+            dependency.get();
+        }
+        PROFILE_ZONE(task->name);
+
+        auto taskStart = std::chrono::steady_clock::now();
+        work();
+        task->startMs = millisecondsBetween(origin, taskStart);
+        task->durationMs = millisecondsBetween(taskStart, std::chrono::steady_clock::now());
+        task->onWorker = true;
+    }).share();
+    return id;
+}
+
+TaskGraph::TaskId TaskGraph::runHere(const char* name, std::function<void()> work, std::vector<TaskId> dependencies) {
+    for (TaskId dependency : dependencies) {
+        wait(dependency);
+    }
+
+    auto task = std::make_shared<Task>();
+    task->name = name;
+
+    // Run through a packaged_task so a failure is stored like a worker's, and rethrown right away
+    std::packaged_task<void()> packaged([this, &task, &work]() {
+        PROFILE_ZONE(task->name);
+        auto taskStart = std::chrono::steady_clock::now();
+        work();
+        task->startMs = millisecondsBetween(origin, taskStart);
+        task->durationMs = millisecondsBetween(taskStart, std::chrono::steady_clock::now());
+    });
+    task->done = packaged.get_future().share();
+
+    TaskId id = tasks.size();
+    tasks.push_back(task);
+    packaged();
+    task->done.get();
+    return id;
+}
+
+void TaskGraph::wait(TaskId task) {
+    tasks.at(task)->done.get();
+}
+
+void TaskGraph::finish() {
+    // Wait on everything before rethrowing, so no worker is left running a task when the pool stops
+    std::exception_ptr failure;
+    for (auto& task : tasks) {
+        try {
+            task->done.get();
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    pool.stop();
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void TaskGraph::report() const {
+    double end = 0.0;
+    double busy = 0.0;
+    std::cout << "\n\tStartup phases (ms since start, duration):" << std::endl;
+    for (const auto& task : tasks) {
+        std::cout << "\t" << std::fixed << std::setprecision(1) << std::setw(8) << task->startMs << std::setw(8) << task->durationMs
+                  << "  " << task->name << (task->onWorker ? " [worker]" : "") << std::endl;
+        end = std::max(end, task->startMs + task->durationMs);
+        busy += task->durationMs;
+    }
+    std::cout << "\tStartup: " << end << " ms wall clock for " << busy << " ms of work" << std::defaultfloat << std::endl;
+}
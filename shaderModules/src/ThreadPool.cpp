@@ -0,0 +1,42 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+void ThreadPool::start(uint32_t threadCount, const std::string& threadName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = false;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, threadName);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    workers.clear();
+}
+
+void ThreadPool::workerLoop(std::string threadName) {
+    Profiler::setThreadName(threadName);
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this]() { return stopping || !queue.empty(); });
+            // Drain the queue before exiting so no future is left without a value
+            if (queue.empty()) {
+                return;
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+    }
+}
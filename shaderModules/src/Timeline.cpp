@@ -0,0 +1,63 @@
+#include "Timeline.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void QueueTimeline::init(VkDevice logicalDevice, const std::string& timelineName) {
+    device = logicalDevice;
+    name = timelineName;
+    submitted = 0;
+    completedValue = 0;
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create " + name + " timeline semaphore!");
+    }
+}
+
+void QueueTimeline::destroy() {
+    if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+        semaphore = VK_NULL_HANDLE;
+    }
+}
+
+uint64_t QueueTimeline::completed() {
+    uint64_t value = 0;
+    if (vkGetSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS) {
+        throw std::runtime_error("failed to read " + name + " timeline value!");
+    }
+    completedValue = std::max(completedValue, value);
+    return completedValue;
+}
+
+bool QueueTimeline::reached(uint64_t value) {
+    return value <= completedValue || value <= completed();
+}
+
+void QueueTimeline::wait(uint64_t value) {
+    if (value <= completedValue) {
+        return;
+    }
+    PROFILE_ZONE("wait for timeline");
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+
+    if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for " + name + " timeline!");
+    }
+    completedValue = std::max(completedValue, value);
+}
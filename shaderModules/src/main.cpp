@@ -7,17 +7,54 @@
 #include <vector>
 #include <cstring>
 #include <optional>
+#include <map>
 #include <set>
 #include <string>
 #include <cstdint> // for uint32_t
 #include <limits> // std::numeric_limits (std::numeric_limits::max() = 0xFFFFFFFFF highest possible 32 bit unsigened int)
 #include <algorithm> // std::clamp (Make sure width is not smaller than min or larger than max)
-#include <fstream>
+#include <chrono>
+#include <memory>
+
+#include "Config.h"
+#include "PipelineCache.h"
+#include "SpirvBlob.h"
+#include "SpirvReflect.h"
+#include "PipelineLayoutCache.h"
+#include "PipelineVariants.h"
+#include "GraphicsPipeline.h"
+#include "PipelineBuildService.h"
+#include "ShaderWatcher.h"
+#include "ShaderModuleCache.h"
+#include "PipelineLibrary.h"
+#include "DynamicState.h"
+#include "ShaderObjects.h"
+#include "OffscreenTarget.h"
+#include "Profiler.h"
+#include "TaskGraph.h"
+#include "DeviceCapabilities.h"
+#include "CoreFeatures.h"
+#include "DeviceSelection.h"
+#include "PresentPolicy.h"
+#include "FramePacer.h"
+#include "Timeline.h"
+
+#ifdef VULK_EMBEDDED_SHADERS
+#include "EmbeddedShaders.h" // generated at build time by shaders/embed_spirv.cmake
+#endif
 
 // globals
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+// How many frames the CPU may record ahead of the GPU. Each frame in flight owns its own command buffer,
+// fence and image-available semaphore, so frame N+1 can be recorded while the GPU is still executing frame N.
+// Override at runtime with VULK_FRAMES_IN_FLIGHT
+const uint32_t DEFAULT_MAX_FRAMES_IN_FLIGHT = 2;
+
+// Taken during static initialization, as close to process start as we can get, for the time-to-first-frame report
+static const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
@@ -62,35 +99,35 @@ void DestroyDebugUtilsMessengerEXT(
     }
 }
 
-static std::vector<char> readFile(const std::string& filename) {
-    /*
-    Reads all of the bytes from the specified file and returns them in byte array
-    managed by std::vector
-    ate : start reading at the end of the file
-    binary : Read the file as a binary(avoid text transformations)
-
-    # We start reading from the end cuz we can determine the size of the file
-      and allocate a buffer
-    */
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file!");
-    }
-    size_t fileSize = (size_t) file.tellg();
-    std::vector<char> buffer(fileSize); // Create buffer
-    std::cout << "\tBuffer size: " << fileSize << "\n";
-    file.seekg(0); // Go to the beginning of the file
-    file.read(buffer.data(), fileSize); // (startPtr, endPtr)
-    file.close();
-
-    return buffer;
+// Returns the bytecode of a compiled shader (e.g. "vert.spv").
+// Loose files win when VULK_SHADER_DIR is set, so shaders can be iterated on without rebuilding.
+// Otherwise the copy compiled into the executable is used and no file I/O happens at all
+static SpirvBlob loadShaderCode(const std::string& name) {
+#ifdef VULK_EMBEDDED_SHADERS
+    if (envString("VULK_SHADER_DIR").empty()) {
+        for (const auto& shader : embeddedShaders) {
+            if (name == shader.name) {
+                return SpirvBlob::view(shader.words, shader.wordCount, name);
+            }
+        }
+    }
+#endif
+    return SpirvBlob(resolveShaderPath(name));
 }
 
 class HelloTriangleApplication {
 public:
     void run()  {
-        initWindow();
-        initVulkan();
+        // VULK_HEADLESS=1 renders into offscreen images, without a window, surface or swap chain (see OffscreenTarget.h)
+        headless = envFlag("VULK_HEADLESS");
+
+        // VULK_PROFILE=trace.json records CPU zones and GPU timestamps and writes them as a Chrome trace at exit
+        profilePath = envString("VULK_PROFILE");
+        if (!profilePath.empty()) {
+            Profiler::enable(envUint("VULK_PROFILE_RING", 16384), envUint("VULK_PROFILE_MAX_EVENTS", 1u << 20));
+            Profiler::setThreadName("main");
+        }
+        initVulkan(); // creates the window too, unless headless
         mainLoop();
         cleanup();
     }
@@ -102,10 +139,16 @@ private:
         std::optional<uint32_t> graphicsFamily;
 
         std::optional<uint32_t> presentFamily; // presentation-capable family
+        bool presentRequired = true; // false in headless mode, nothing is ever presented
+
+        // Families without the graphics bit, so work on them can overlap with rendering. Unset when the device has none,
+        // the graphics queue does that work then
+        std::optional<uint32_t> transferFamily; // transfer only if there is such a family, otherwise compute + transfer
+        std::optional<uint32_t> computeFamily; // compute without graphics (async compute)
 
         bool isComplete() {
 
-            return graphicsFamily.has_value() && presentFamily.has_value();
+            return graphicsFamily.has_value() && (presentFamily.has_value() || !presentRequired);
         }
     };
 
@@ -115,18 +158,82 @@ private:
         std::vector<VkPresentModeKHR> presentModes; 
     };
 
-    GLFWwindow *window;
+    GLFWwindow *window = nullptr; // stays null in headless mode
+    bool headless = false;
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE; // just a nullptr macro // GPU physical device
     VkDevice device; // Logical device
     
+    // Queried once per device while picking one (see DeviceCapabilities.h), this is the snapshot of physicalDevice
+    DeviceCapabilities capabilities;
+
+    // Vulkan 1.1 - 1.3 core features the device was created with (see CoreFeatures.h), for picking code paths at runtime
+    CoreFeatureNegotiator coreFeatures;
+
     VkQueue graphicsQueue;
+    // For uploads and async compute. They are the graphics queue (and family) when there is no dedicated family, see findQueueFamilies.
+    // Roles that ended up on the same VkQueue must not submit from different threads without a lock
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    VkQueue computeQueue = VK_NULL_HANDLE;
+    uint32_t transferQueueFamily = 0;
+    uint32_t computeQueueFamily = 0;
     VkQueue presentQueue;
+    uint32_t graphicsQueueFamily = 0;
+    uint32_t presentQueueFamily = 0;
 
     VkSurfaceKHR surface;
 
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+
+    /*
+    Resizing. The window is resizable and the swap chain is recreated without waiting for the device to go idle.
+    # The new swap chain is created with the current one as oldSwapchain, so the presentation engine can hand over.
+    # The old swap chain and everything made for its images are retired like replaced pipelines (see destroyRetired):
+      frames already submitted keep using them until their fences are waited on.
+    # A resize event or a SUBOPTIMAL result only marks the swap chain as stale. It is recreated once no new resize came
+      in for VULK_RESIZE_DEBOUNCE_MS, so dragging the window edge doesn't recreate on every step.
+      VK_ERROR_OUT_OF_DATE_KHR can't be rendered around and recreates right away.
+    */
+    struct RetiredSwapChain {
+        VkSwapchainKHR swapChain;
+        std::vector<VkImageView> imageViews;
+        std::vector<VkFramebuffer> framebuffers;
+        std::vector<VkSemaphore> renderFinishedSemaphores;
+        std::vector<VkCommandBuffer> presentAcquireCommandBuffers;
+        std::vector<VkSemaphore> presentAcquiredSemaphores;
+        uint64_t retiredAt; // see retirePoint()
+        uint64_t retiredAtFrame;
+    };
+    std::vector<RetiredSwapChain> retiredSwapChains;
+    bool swapChainStale = false;
+    bool swapChainOutOfDate = false; // stale and can't be presented to anymore, skips the debounce
+    std::chrono::steady_clock::time_point lastResize;
+    std::chrono::milliseconds resizeDebounce{0};
+    uint32_t swapChainRecreations = 0;
+
+    // Present mode and image count of the swap chain, VULK_PRESENT_MODE (see PresentPolicy.h)
+    PresentModePolicy presentPolicy;
+    std::chrono::steady_clock::time_point lastPresent;
+
+    // Low-latency pacing (VULK_FRAME_PACING=1, see FramePacer.h), stays disabled otherwise
+    FramePacer framePacer;
+
+    /*
+    Render on demand (VULK_RENDER_ON_DEMAND=1). Instead of spinning on glfwPollEvents, mainLoop blocks in
+    glfwWaitEventsTimeout until something changed, so an unchanged window costs no CPU and no GPU time.
+    # markDirty() is called by whatever changes what is on screen: keys, resizes, expose events, a hot reload swap.
+    # After each change rendering stays continuous for VULK_IDLE_AFTER_MS (default 500), so interaction and anything
+      animating in response to it run at the full frame rate. keepRendering() extends that window, e.g. for an animation.
+    # The wait times out every VULK_IDLE_POLL_MS (default 100) so pipeline housekeeping and hot reload keep running.
+    # Runs with VULK_MAX_FRAMES render continuously, the frame count would be meaningless otherwise.
+    */
+    bool renderOnDemand = false;
+    bool sceneDirty = true; // the first frame always renders
+    std::chrono::steady_clock::time_point continuousUntil;
+    std::chrono::milliseconds idleAfter{500};
+    double idlePollSeconds = 0.1;
+    uint64_t idleWakeups = 0;
 
     // we can retrive the handles of the VkImage in this vector
     std::vector<VkImage> swapChainImages;
@@ -136,26 +243,337 @@ private:
     // Image views 
     std::vector<VkImageView> swapChainImageViews;
 
+    VkRenderPass renderPass;
+
+    // Headless mode: the swap chain images and views above point into this target, one image per frame in flight
+    OffscreenTarget offscreenTarget;
+    uint32_t lastImageIndex = 0; // the image the most recent frame rendered to
+
+    // Profiling (see Profiler.h), only set up when VULK_PROFILE names an output file
+    std::string profilePath;
+    GpuProfiler gpuProfiler;
+
+    /*
+    Shader bytecode, its reflection, the modules and every pipeline built from them.
+    # The modules stay alive after startup so new specialization variants can be built on demand.
+    # Hot reload builds a complete new program next to the current one and swaps it in at a frame boundary,
+      so a program is never modified while frames in flight may still be using it.
+    # The code is shared, a reload only replaces the stages whose source changed.
+    */
+    struct ShaderProgram {
+        std::shared_ptr<const SpirvBlob> vertShaderCode;
+        std::shared_ptr<const SpirvBlob> fragShaderCode;
+        ShaderReflection vertReflection;
+        ShaderReflection fragReflection;
+        ShaderModuleRef vertShaderModule; // shared through moduleCache with every program that has the same bytecode
+        ShaderModuleRef fragShaderModule;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE; // owned by layoutCache
+        PipelineVariantCache variants; // pipelines keyed by their specialization-constant values and baked raster state
+
+        // With the graphics pipeline library a variant is first fast-linked, these optimized links replace them when done
+        struct PipelineUpgrade {
+            PipelineVariantKey key;
+            std::shared_future<VkPipeline> optimized;
+        };
+        std::vector<PipelineUpgrade> upgrades;
+
+        // Shader object mode: the program's VkShaderEXTs, compiled on the build workers instead of its variants
+        std::shared_future<ShaderObjectSet> shaderObjectBuild;
+    };
+
+    std::unique_ptr<ShaderProgram> program;
+    SpecializationKey activeSpecialization;
+    VkPipeline graphicsPipeline = VK_NULL_HANDLE; // the active variant of program, used for drawing (not in shader object mode)
+
+    // Cull mode, front face etc. of the draw, changed with the keyboard (see onKey). In the extended dynamic state mode
+    // (VULK_DYNAMIC_STATE=1) the groups dynamicRaster covers are recorded per draw instead of picking another variant
+    RasterState rasterState;
+    DynamicRasterState dynamicRaster;
+    // A key press waiting for its variant. rasterState keeps the old value until updateRasterState swaps both in
+    std::optional<RasterState> pendingRasterState;
+    std::shared_future<VkPipeline> pendingRasterPipeline;
+    uint32_t dynamicRasterSupport = 0; // DynamicRasterBits the device can make dynamic, found in createLogicDevice
+    bool wireframeSupported = false; // fillModeNonSolid
+
+    // Hot reload (VULK_HOT_RELOAD=1). The pending program is swapped in once its pipeline has finished compiling,
+    // replaced programs are destroyed once no frame in flight can reference them anymore
+    struct RetiredProgram {
+        std::unique_ptr<ShaderProgram> program;
+        uint64_t retiredAt; // see retirePoint()
+    };
+
+    ShaderWatcher shaderWatcher;
+    std::unique_ptr<ShaderProgram> pendingProgram;
+    std::shared_future<VkPipeline> pendingPipeline;
+    std::vector<RetiredProgram> retiredPrograms;
+    uint64_t frameNumber = 0; // frames submitted so far
+
+    // Single pipelines that were replaced (e.g. a fast link by its optimized link), destroyed like retired programs
+    struct RetiredPipeline {
+        VkPipeline pipeline;
+        uint64_t retiredAt;
+    };
+    std::vector<RetiredPipeline> retiredPipelines;
+
+    // Worker threads that compile the variants, sharing pipelineCache
+    PipelineBuildService pipelineBuilder;
+
+    // Owns the descriptor set / pipeline layouts derived from shader reflection, identical layouts are shared
+    PipelineLayoutCache layoutCache;
+
+    // Shader modules keyed by a hash of their SPIR-V, identical bytecode gets one module
+    ShaderModuleCache moduleCache;
+    bool shaderModuleIdentifiers = false; // VK_EXT_shader_module_identifier is enabled
+
+    // Graphics pipeline library parts. Only used when VK_EXT_graphics_pipeline_library with fast linking is available
+    PipelineLibrary pipelineLibrary;
+    bool pipelineLibraryEnabled = false;
+
+    // VK_EXT_shader_object backend (VULK_SHADER_OBJECTS=1), picked once at startup. No pipeline variants are built then,
+    // the draw binds activeShaderObjects, made from the program and its specialization, and sets all state itself
+    ShaderObjectBackend shaderObjects;
+    ShaderObjectSet activeShaderObjects;
+    bool shaderObjectsEnabled = false;
+
+    // Loaded from disk at startup and written back in cleanup, so warm starts skip most of the driver compile
+    PipelineCache pipelineCache;
+
+    // One framebuffer per swap chain image view
+    std::vector<VkFramebuffer> swapChainFramebuffers;
+
+    VkCommandPool commandPool;
+    VkCommandPool transferCommandPool = VK_NULL_HANDLE; // for transferQueue
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE; // for computeQueue
+
+    // Everything one frame in flight needs. The frames live in a ring indexed by currentFrame
+    struct FrameData {
+        VkCommandBuffer commandBuffer;
+        VkSemaphore imageAvailableSemaphore; // signaled when the acquired swap chain image is ready to be rendered to
+        VkFence inFlightFence = VK_NULL_HANDLE; // signaled when the GPU has finished this frame's command buffer, fence mode only
+        uint64_t timelineValue = 0; // graphicsTimeline value its last submit signals, timeline mode only
+        uint64_t submitNumber = 0; // frameNumber after its last submit, 0 before the first
+    };
+
+    uint32_t maxFramesInFlight = DEFAULT_MAX_FRAMES_IN_FLIGHT;
+    std::vector<FrameData> frames;
+    uint32_t currentFrame = 0;
+
+    // Render-finished semaphores are indexed by swap chain image rather than by frame, because presentation
+    // holds on to them until that image is handed back to us by vkAcquireNextImageKHR
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+
+    /*
+    Timeline semaphores (VULK_TIMELINE_SEMAPHORES, on by default where the device has them, see Timeline.h).
+    # Every graphics submit signals the next graphicsTimeline value. A frame slot waits for the value its previous
+      submit signalled instead of a fence, so no fences are created at all.
+    # Retired pipelines and programs remember the last submitted value and go once the GPU got past it.
+    # With the ownership transfer the acquire on presentQueue waits on the timeline value directly, the graphics
+      submit then only signals a binary semaphore when vkQueuePresentKHR itself has to wait on it (it can't wait on a timeline).
+    # Without the feature everything falls back to the per-frame fences and frame counting.
+    */
+    bool timelineSync = false;
+    QueueTimeline graphicsTimeline;
+
+    /*
+    Swap chain images when the graphics and present queues are in different families (VULK_SWAPCHAIN_SHARING).
+    # exclusive (default): the images stay VK_SHARING_MODE_EXCLUSIVE. The frame's command buffer releases the image to the
+      present family, and a command buffer on presentQueue acquires it before vkQueuePresentKHR waits on it.
+      Many drivers turn framebuffer compression off for concurrent images, so this saves bandwidth on every frame.
+    # concurrent: both families use the images without any transfer, what the tutorial does.
+    # The render pass clears the image (initialLayout UNDEFINED), so nothing has to be transferred back before rendering.
+    # Nothing of this is used when one family does both, which is the common case.
+    */
+    bool concurrentSwapChainSharing = false;
+    bool swapChainOwnershipTransfer = false; // set by createSwapChain
+    VkCommandPool presentCommandPool = VK_NULL_HANDLE; // only with separate graphics and present families
+    std::vector<VkCommandBuffer> presentAcquireCommandBuffers; // per swap chain image, recorded once
+    std::vector<VkSemaphore> presentAcquiredSemaphores; // per swap chain image, what the present waits on instead of renderFinished
+
 
 private:
     void initWindow() {
-        glfwInit();
+        glfwInit(); // a no-op when initVulkan already did it
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+
+        // The callbacks are plain functions, they find their way back to us through the window user pointer
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+
+        // The adaptive present mode judges frame intervals against the refresh rate
+        if (GLFWmonitor* monitor = glfwGetPrimaryMonitor()) {
+            if (const GLFWvidmode* videoMode = glfwGetVideoMode(monitor)) {
+                presentPolicy.setRefreshRate(videoMode->refreshRate);
+                framePacer.setRefreshRate(videoMode->refreshRate);
+            }
+        }
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int /*width*/, int /*height*/) {
+        auto app = static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->swapChainStale = true;
+        app->lastResize = std::chrono::steady_clock::now();
+        app->markDirty();
+    }
+
+    // The window system lost the window contents (uncovered, restored), they have to be drawn again
+    static void windowRefreshCallback(GLFWwindow* window) {
+        static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->markDirty();
+    }
+
+    void markDirty() {
+        sceneDirty = true;
+        keepRendering(idleAfter);
+    }
+
+    void keepRendering(std::chrono::milliseconds duration) {
+        continuousUntil = std::max(continuousUntil, std::chrono::steady_clock::now() + duration);
+    }
+
+    bool frameNeeded() {
+        return sceneDirty || swapChainStale || std::chrono::steady_clock::now() < continuousUntil;
+    }
+
+    // A minimized window has a 0x0 framebuffer, no swap chain can be created for it
+    bool windowMinimized() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        return width == 0 || height == 0;
+    }
+
+    static void keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+        if (action == GLFW_PRESS) {
+            static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->onKey(key);
+        }
+    }
+
+    /*
+    Raster state keys: C cycles the cull mode, F flips the front face, W toggles wireframe (when fillModeNonSolid is supported).
+    # With shader objects the new state is simply recorded from the next frame on.
+    # With baked state every new combination is another pipeline variant, built the first time it is used.
+      The key only queues it on the build workers, updateRasterState swaps it in at a frame boundary once it is ready.
+    # With the extended dynamic state mode they all map onto the same variant and only the recorded state changes,
+      the variant count that is printed stays the same.
+    */
+    void onKey(int key) {
+        // Keys pressed while a variant is still building stack on top of the state it is building
+        RasterState next = pendingRasterState.value_or(rasterState);
+        if (key == GLFW_KEY_C) {
+            next.cullMode = next.cullMode == VK_CULL_MODE_NONE ? VK_CULL_MODE_BACK_BIT :
+                            next.cullMode == VK_CULL_MODE_BACK_BIT ? VK_CULL_MODE_FRONT_BIT : VK_CULL_MODE_NONE;
+        } else if (key == GLFW_KEY_F) {
+            next.frontFace = next.frontFace == VK_FRONT_FACE_CLOCKWISE ? VK_FRONT_FACE_COUNTER_CLOCKWISE : VK_FRONT_FACE_CLOCKWISE;
+        } else if (key == GLFW_KEY_W && wireframeSupported) {
+            next.polygonMode = next.polygonMode == VK_POLYGON_MODE_FILL ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+        } else {
+            return;
+        }
+
+        if (shaderObjectsEnabled) {
+            // Shader objects record the whole raster state per draw, nothing has to be built for it
+            rasterState = next;
+            markDirty();
+            std::cout << "Raster state " << rasterState.toString() << std::endl;
+            return;
+        }
+
+        try {
+            pendingRasterPipeline = program->variants.request(variantKeyFor(next));
+            pendingRasterState = next;
+        } catch (const std::exception& e) {
+            std::cerr << "Raster state " << next.toString() << ": " << e.what() << std::endl;
+            return;
+        }
+        markDirty();
     }
 
     void initVulkan() {
-        createInstance();
-        setupDebugMessenger();
-        createSurface(); // surface must be made after the creation of instance as it actualy influences the physiacal device setup
-        pickPhysicalDevice();
-        createLogicDevice();
-        createSwapChain();
-        createImageViews();
-        createGraphicsPipeline();
+        PROFILE_ZONE("initVulkan");
+        /*
+        Startup runs on a small task graph (see TaskGraph.h) and every phase is timed, the table is printed at the end.
+        # Instance creation, loading and reflecting the shaders, and reading the pipeline cache blob run on workers,
+          next to window creation and logical device creation on the main thread.
+        # GLFW wants windows created on the main thread, so that stays here while a worker creates the instance.
+        # Everything from the logical device on depends on the step before it and runs on the main thread.
+        # VULK_SERIAL_INIT=1 runs all of it inline, one phase after another, as the baseline to compare against.
+        */
+        TaskGraph startup;
+        startup.start(envFlag("VULK_SERIAL_INIT") ? 0 : 2);
+        concurrentSwapChainSharing = envString("VULK_SWAPCHAIN_SHARING", "exclusive") == "concurrent";
+        resizeDebounce = std::chrono::milliseconds(envUint("VULK_RESIZE_DEBOUNCE_MS", 50));
+        presentPolicy.configure(envString("VULK_PRESENT_MODE"), envUint("VULK_SWAPCHAIN_IMAGES", 0));
+        renderOnDemand = envFlag("VULK_RENDER_ON_DEMAND") && !headless && envUint("VULK_MAX_FRAMES", 0) == 0;
+        idleAfter = std::chrono::milliseconds(envUint("VULK_IDLE_AFTER_MS", 500));
+        idlePollSeconds = envUint("VULK_IDLE_POLL_MS", 100) / 1000.0;
+
+        if (!headless) {
+            glfwInit(); // before the instance task asks GLFW for the instance extensions it needs
+        }
+        TaskGraph::TaskId instanceTask = startup.add("create instance", [this]() {
+            createInstance();
+            setupDebugMessenger();
+        });
+        TaskGraph::TaskId shadersTask = startup.add("load shaders", [this]() {
+            // Embedded at build time, or memory-mapped from VULK_SHADER_DIR (see loadShaderCode)
+            program = loadShaderProgram(std::make_shared<SpirvBlob>(loadShaderCode("vert.spv")),
+                                        std::make_shared<SpirvBlob>(loadShaderCode("frag.spv")));
+        });
+        if (!headless) {
+            startup.runHere("create window", [this]() { initWindow(); });
+            // surface must be made after the creation of instance as it actualy influences the physiacal device setup
+            startup.runHere("create surface", [this]() { createSurface(); }, {instanceTask});
+        }
+        startup.runHere("pick physical device", [this]() { pickPhysicalDevice(); }, {instanceTask});
+        // The blob's file name comes from the physical device, its contents are only needed by vkCreatePipelineCache
+        TaskGraph::TaskId cacheTask = startup.add("read pipeline cache", [this]() { pipelineCache.load(capabilities); });
+        startup.runHere("create logical device", [this]() { createLogicDevice(); });
+        startup.runHere("create caches", [this]() {
+            pipelineCache.create(device);
+            layoutCache.init(device);
+            moduleCache.init(device, shaderModuleIdentifiers);
+            dynamicRaster.init(device, dynamicRasterSupport);
+            if (shaderObjectsEnabled) {
+                shaderObjects.init(device, layoutCache);
+            }
+        }, {cacheTask});
+        maxFramesInFlight = std::max(1u, envUint("VULK_FRAMES_IN_FLIGHT", DEFAULT_MAX_FRAMES_IN_FLIGHT));
+        if (headless) {
+            startup.runHere("create offscreen target", [this]() { createOffscreenTarget(); });
+        } else {
+            startup.runHere("create swap chain", [this]() { createSwapChain(); });
+            startup.runHere("create image views", [this]() { createImageViews(); });
+        }
+        startup.runHere("create render pass", [this]() { createRenderPass(); });
+        startup.runHere("create graphics pipeline", [this]() { createGraphicsPipeline(); }, {shadersTask});
+        startup.runHere("create framebuffers", [this]() { createFramebuffers(); });
+        startup.runHere("create command buffers", [this]() {
+            createCommandPool();
+            createCommandBuffers();
+            createSyncObjects();
+            createOwnershipTransferCommands();
+        });
+        if (Profiler::enabled()) {
+            gpuProfiler.init(capabilities, device, findQueueFamilies(capabilities).graphicsFamily.value(), maxFramesInFlight);
+        }
+        startup.finish();
+        startup.report();
+
+        // VULK_SHADER_OBJECT_BENCH=N compares compile and bind cost of pipelines and shader objects
+        uint32_t shaderObjectBenchCount = envUint("VULK_SHADER_OBJECT_BENCH", 0);
+        if (shaderObjectBenchCount > 0 && shaderObjectsEnabled) {
+            benchmarkShaderObjects(shaderObjectBenchCount);
+        }
+
+        // VULK_SHARING_BENCH=N renders N frames with concurrent and with exclusive swap chain images
+        uint32_t sharingBenchCount = envUint("VULK_SHARING_BENCH", 0);
+        if (sharingBenchCount > 0 && !headless) {
+            benchmarkSwapChainSharing(sharingBenchCount);
+        }
     }
 
     // Althought the creation of VkSurfaceKHR object and its usage are platform agnostic, it's creation it'nt
@@ -168,10 +586,7 @@ private:
     }
 
     void createLogicDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        QueueFamilyIndices indices = findQueueFamilies(capabilities);
 
 /* This below implementation is commented out cuz you did this before bringing in graphics family queue
         // Prepares a request for a queue from that family
@@ -180,20 +595,45 @@ private:
         queueCreateInfo.queueFamilyIndex = indices.graphicsFamily.value(); // determines which queue family we are gonna use
         queueCreateInfo.queueCount = 1; // we want one queue (we can select more but just 1 would suffice)
 */
-        // Vulkan lets us assign priorities to queues to influence the scheduling of command buffer execution
-        float queuePriority = 1.f;
-        for (uint32_t queueFamily : uniqueQueueFamilies) {
+        /*
+        Vulkan lets us assign priorities to queues to influence the scheduling of command buffer execution.
+        # Every role asks for a queue of its family. Graphics and present share one queue when they share a family.
+        # Transfer and compute get their own queue when their family has enough of them, otherwise they share queue 0 of it.
+        # Uploads and async compute run at a lower priority than rendering, so they fill gaps instead of delaying frames.
+        */
+        std::map<uint32_t, std::vector<float>> queuePriorities; // family -> one priority per queue to create
+        auto requestQueue = [&](uint32_t family, float priority) -> uint32_t {
+            std::vector<float>& priorities = queuePriorities[family];
+            if (priorities.size() < capabilities.queueFamilies[family].queueCount) {
+                priorities.push_back(priority);
+                return static_cast<uint32_t>(priorities.size() - 1); // index of the queue within its family
+            }
+            return 0; // the family is full, so share its first queue
+        };
+
+        uint32_t graphicsQueueIndex = requestQueue(indices.graphicsFamily.value(), 1.0f);
+        uint32_t presentQueueIndex = graphicsQueueIndex;
+        if (indices.presentFamily.has_value() && indices.presentFamily != indices.graphicsFamily) {
+            presentQueueIndex = requestQueue(indices.presentFamily.value(), 1.0f);
+        }
+        transferQueueFamily = indices.transferFamily.value_or(indices.graphicsFamily.value());
+        uint32_t transferQueueIndex = indices.transferFamily.has_value() ? requestQueue(transferQueueFamily, 0.5f) : graphicsQueueIndex;
+        computeQueueFamily = indices.computeFamily.value_or(indices.graphicsFamily.value());
+        uint32_t computeQueueIndex = indices.computeFamily.has_value() ? requestQueue(computeQueueFamily, 0.5f) : graphicsQueueIndex;
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        for (const auto& [queueFamily, priorities] : queuePriorities) {
             VkDeviceQueueCreateInfo queueCreateInfo{};
             queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
             queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfo.queueCount = static_cast<uint32_t>(priorities.size());
+            queueCreateInfo.pQueuePriorities = priorities.data();
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
         // Specifies the set of device features that we will be using
         /*
-        Right now you are enabling no optional features.
+        Right now the only optional feature is fillModeNonSolid, for the wireframe toggle when the device has it.
            # Examples of optional features:
            # geometry shaders
            # tessellation
@@ -202,7 +642,233 @@ private:
            # multi viewport
            # fill modes
         */
+        const VkPhysicalDeviceFeatures& supportedFeatures = capabilities.features;
         VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+        wireframeSupported = supportedFeatures.fillModeNonSolid == VK_TRUE;
+
+        /*
+        Optional extensions, each with its feature struct:
+           # VK_EXT_shader_module_identifier lets a pipeline that is already in the pipeline cache be created
+             from a short identifier instead of the full SPIR-V (see ShaderModuleCache). It also needs pipelineCreationCacheControl
+             for VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT (core in 1.3, an extension before that).
+             VULK_SHADER_MODULE_IDENTIFIER=0 turns it off.
+           # VK_EXT_graphics_pipeline_library compiles pipelines in parts that are linked per variant (see PipelineLibrary).
+             Only worth it when the driver can link fast. VULK_PIPELINE_LIBRARY=0 turns it off.
+           # VK_EXT_extended_dynamic_state and _2 (core in 1.3) and VK_EXT_extended_dynamic_state3 (polygon mode) make
+             raster state dynamic, so it no longer needs a pipeline per combination (see DynamicState.h). Opt in with VULK_DYNAMIC_STATE=1.
+           # VK_EXT_shader_object replaces pipelines with per-stage shaders and fully dynamic state (see ShaderObjects.h).
+             Only on 1.3 devices, where the dynamic state it builds on is core. Its draws have no render pass, so it also
+             needs the dynamicRendering feature from coreFeatures and falls back to pipelines without it. Opt in with VULK_SHADER_OBJECTS=1.
+           # VK_KHR_present_id and VK_KHR_present_wait let the frame pacer wait for a frame to reach the screen (see FramePacer.h).
+             Only with VULK_FRAME_PACING=1, without them the pacer falls back to fences.
+        Features that are core in 1.1 - 1.3 go through coreFeatures instead, which enables them with the Vulkan11/12/13Features structs:
+           # timelineSemaphore (1.2) replaces the per-frame fences with one timeline per queue. VULK_TIMELINE_SEMAPHORES=0 turns it off.
+           # pipelineCreationCacheControl (1.3) for the shader module identifiers, on older devices it still comes from the extension.
+           # whatever VULK_DEVICE_FEATURES names, to try out paths that aren't on by default.
+        */
+        std::vector<const char*> enabledExtensions = requiredDeviceExtensions();
+
+        VkPhysicalDevicePipelineCreationCacheControlFeatures cacheControlFeatures{};
+        cacheControlFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES;
+        VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT identifierFeatures{};
+        identifierFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+        libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures{};
+        dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicState2Features{};
+        dynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicState3Features{};
+        dynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures{};
+        shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+        const VkPhysicalDeviceProperties& deviceProperties = capabilities.properties;
+        bool cacheControlAvailable = deviceProperties.apiVersion >= VK_API_VERSION_1_3 ||
+                                     capabilities.hasExtension(VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME);
+
+        bool identifierCandidate = envFlag("VULK_SHADER_MODULE_IDENTIFIER", true) && cacheControlAvailable &&
+                                   capabilities.hasExtension(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME);
+        bool libraryCandidate = envFlag("VULK_PIPELINE_LIBRARY", true) &&
+                                capabilities.hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+                                capabilities.hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+
+        // The first two are core in 1.3, there the commands are always available and no feature has to be enabled
+        bool dynamicStateRequested = envFlag("VULK_DYNAMIC_STATE");
+        bool coreDynamicState = deviceProperties.apiVersion >= VK_API_VERSION_1_3;
+        bool dynamicStateCandidate = dynamicStateRequested && !coreDynamicState &&
+                                     capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        bool dynamicState2Candidate = dynamicStateRequested && !coreDynamicState &&
+                                      capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+        bool dynamicState3Candidate = dynamicStateRequested && wireframeSupported &&
+                                      capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        bool shaderObjectCandidate = envFlag("VULK_SHADER_OBJECTS") && deviceProperties.apiVersion >= VK_API_VERSION_1_3 &&
+                                     capabilities.hasExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        bool framePacingRequested = envFlag("VULK_FRAME_PACING") && !headless;
+        bool presentWaitCandidate = framePacingRequested && capabilities.hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+                                    capabilities.hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        bool coreCacheControl = deviceProperties.apiVersion >= VK_API_VERSION_1_3;
+
+        if (envFlag("VULK_TIMELINE_SEMAPHORES", true)) {
+            coreFeatures.request(CoreFeature::TimelineSemaphore);
+        }
+        if (identifierCandidate && coreCacheControl) {
+            coreFeatures.request(CoreFeature::PipelineCreationCacheControl);
+        }
+        if (shaderObjectCandidate) {
+            coreFeatures.request(CoreFeature::DynamicRendering);
+        }
+        coreFeatures.requestFromEnvironment();
+        coreFeatures.negotiate(physicalDevice, deviceProperties.apiVersion);
+
+        // Only structs of extensions the device actually has may go into the query chain
+        VkPhysicalDeviceFeatures2 supported{};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        void** next = &supported.pNext;
+        if (identifierCandidate) {
+            *next = &identifierFeatures;
+            next = &identifierFeatures.pNext;
+            if (!coreCacheControl) {
+                *next = &cacheControlFeatures;
+                next = &cacheControlFeatures.pNext;
+            }
+        }
+        if (libraryCandidate) {
+            *next = &libraryFeatures;
+            next = &libraryFeatures.pNext;
+        }
+        if (dynamicStateCandidate) {
+            *next = &dynamicStateFeatures;
+            next = &dynamicStateFeatures.pNext;
+        }
+        if (dynamicState2Candidate) {
+            *next = &dynamicState2Features;
+            next = &dynamicState2Features.pNext;
+        }
+        if (dynamicState3Candidate) {
+            *next = &dynamicState3Features;
+            next = &dynamicState3Features.pNext;
+        }
+        if (shaderObjectCandidate) {
+            *next = &shaderObjectFeatures;
+            next = &shaderObjectFeatures.pNext;
+        }
+        if (presentWaitCandidate) {
+            *next = &presentIdFeatures;
+            presentIdFeatures.pNext = &presentWaitFeatures;
+            next = &presentWaitFeatures.pNext;
+        }
+        if (supported.pNext != nullptr) {
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+        }
+
+        bool cacheControl = coreCacheControl ? coreFeatures.enabled(CoreFeature::PipelineCreationCacheControl) : cacheControlFeatures.pipelineCreationCacheControl == VK_TRUE;
+        shaderModuleIdentifiers = identifierCandidate && identifierFeatures.shaderModuleIdentifier && cacheControl;
+
+        if (libraryCandidate && libraryFeatures.graphicsPipelineLibrary) {
+            VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties{};
+            libraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &libraryProperties;
+            vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+            // Without fast linking a "fast" link costs about as much as a monolithic build, so there is nothing to gain
+            pipelineLibraryEnabled = libraryProperties.graphicsPipelineLibraryFastLinking;
+        }
+
+        bool extendedDynamicState = dynamicStateRequested && (coreDynamicState || (dynamicStateCandidate && dynamicStateFeatures.extendedDynamicState));
+        bool extendedDynamicState2 = dynamicStateRequested && (coreDynamicState || (dynamicState2Candidate && dynamicState2Features.extendedDynamicState2));
+        bool dynamicPolygonMode = dynamicState3Candidate && dynamicState3Features.extendedDynamicState3PolygonMode;
+        dynamicRasterSupport = dynamicRasterBitsFor(extendedDynamicState, extendedDynamicState2, dynamicPolygonMode);
+        shaderObjectsEnabled = shaderObjectCandidate && shaderObjectFeatures.shaderObject && coreFeatures.enabled(CoreFeature::DynamicRendering);
+        bool presentWaitEnabled = presentWaitCandidate && presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+        timelineSync = coreFeatures.enabled(CoreFeature::TimelineSemaphore);
+
+        // The enable chain holds only what is actually used. The queried structs double as the enable list,
+        // everything in them that is VK_TRUE gets enabled
+        void* enabledFeatures = nullptr;
+        identifierFeatures.pNext = nullptr;
+        cacheControlFeatures.pNext = nullptr;
+        libraryFeatures.pNext = nullptr;
+        dynamicStateFeatures.pNext = nullptr;
+        dynamicState2Features.pNext = nullptr;
+        dynamicState3Features.pNext = nullptr;
+        shaderObjectFeatures.pNext = nullptr;
+        presentIdFeatures.pNext = nullptr;
+        presentWaitFeatures.pNext = nullptr;
+        if (shaderModuleIdentifiers) {
+            enabledExtensions.push_back(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME);
+            // On 1.3 the cache control feature is in coreFeatures, it may not be chained a second time
+            if (!coreCacheControl) {
+                enabledExtensions.push_back(VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME);
+                identifierFeatures.pNext = &cacheControlFeatures;
+            }
+            enabledFeatures = &identifierFeatures;
+        }
+        if (pipelineLibraryEnabled) {
+            enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            libraryFeatures.pNext = enabledFeatures;
+            enabledFeatures = &libraryFeatures;
+        }
+        if (extendedDynamicState && !coreDynamicState) {
+            enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+            dynamicStateFeatures.pNext = enabledFeatures;
+            enabledFeatures = &dynamicStateFeatures;
+        }
+        if (extendedDynamicState2 && !coreDynamicState) {
+            enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+            dynamicState2Features.pNext = enabledFeatures;
+            enabledFeatures = &dynamicState2Features;
+        }
+        if (dynamicPolygonMode) {
+            // Only polygon mode is used out of the many extended_dynamic_state3 features
+            enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+            dynamicState3Features = {};
+            dynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+            dynamicState3Features.extendedDynamicState3PolygonMode = VK_TRUE;
+            dynamicState3Features.pNext = enabledFeatures;
+            enabledFeatures = &dynamicState3Features;
+        }
+        if (shaderObjectsEnabled) {
+            enabledExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+            shaderObjectFeatures.pNext = enabledFeatures;
+            enabledFeatures = &shaderObjectFeatures;
+        }
+        if (presentWaitEnabled) {
+            enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            presentIdFeatures = {};
+            presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+            presentIdFeatures.presentId = VK_TRUE;
+            presentWaitFeatures = {};
+            presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+            presentWaitFeatures.presentWait = VK_TRUE;
+            presentWaitFeatures.pNext = enabledFeatures;
+            presentIdFeatures.pNext = &presentWaitFeatures;
+            enabledFeatures = &presentIdFeatures;
+        }
+        enabledFeatures = coreFeatures.chain(enabledFeatures);
+        std::cout << "\tShader module identifiers: " << (shaderModuleIdentifiers ? "enabled" : "unavailable") << std::endl;
+        std::cout << "\tGraphics pipeline library: " << (pipelineLibraryEnabled ? "enabled" : "unavailable") << std::endl;
+        if (dynamicStateRequested) {
+            std::cout << "\tExtended dynamic state: " << (extendedDynamicState ? "1" : "-") << (extendedDynamicState2 ? " 2" : " -")
+                      << (dynamicPolygonMode ? " 3 (polygon mode)" : " -") << std::endl;
+        }
+        if (envFlag("VULK_SHADER_OBJECTS")) {
+            const char* state = shaderObjectsEnabled ? "enabled"
+                : (shaderObjectCandidate && shaderObjectFeatures.shaderObject) ? "no dynamicRendering, drawing with pipelines"
+                : "unavailable, drawing with pipelines";
+            std::cout << "\tShader objects: " << state << std::endl;
+        }
+        coreFeatures.print();
+        std::cout << "\tFrame synchronization: " << (timelineSync ? "timeline semaphores" : "fences") << std::endl;
 
         // Filling in the main VkDeviceCreateInfo structure
         // This main structure tells vulkan to create a logical device using this GPU, these queues, these features enabled etc.
@@ -223,10 +889,12 @@ private:
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
         createInfo.pEnabledFeatures = &deviceFeatures;
+        // The queried feature structs double as the enable list, everything in them that is VK_TRUE gets enabled
+        createInfo.pNext = enabledFeatures;
 
-        // Enable required device extensions (swapchain)
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        // Enable required device extensions (swapchain) plus the optional ones found above
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 
         if (enableValidationLayers) {
@@ -244,77 +912,119 @@ private:
             std::cout << "\tLogical device made successfully!" << std::endl;
         }
 
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        if (framePacingRequested) {
+            framePacer.init(device, presentWaitEnabled, envUint("VULK_PACING_DEPTH", 1));
+        }
+        if (timelineSync) {
+            graphicsTimeline.init(device, "graphics");
+        }
+
+        graphicsQueueFamily = indices.graphicsFamily.value();
+        vkGetDeviceQueue(device, graphicsQueueFamily, graphicsQueueIndex, &graphicsQueue);
+        if (indices.presentFamily.has_value()) {
+            presentQueueFamily = indices.presentFamily.value();
+            vkGetDeviceQueue(device, presentQueueFamily, presentQueueIndex, &presentQueue);
+        }
+        vkGetDeviceQueue(device, transferQueueFamily, transferQueueIndex, &transferQueue);
+        vkGetDeviceQueue(device, computeQueueFamily, computeQueueIndex, &computeQueue);
+
+        std::cout << "\tQueues: graphics family " << indices.graphicsFamily.value()
+                  << ", transfer " << (indices.transferFamily ? "family " + std::to_string(transferQueueFamily) : std::string("on the graphics queue"))
+                  << ", compute " << (indices.computeFamily ? "family " + std::to_string(computeQueueFamily) : std::string("on the graphics queue"))
+                  << (transferQueue == computeQueue && indices.transferFamily ? " (sharing one queue)" : "") << std::endl;
+        if (indices.presentFamily.has_value() && presentQueueFamily != graphicsQueueFamily) {
+            std::cout << "\tPresenting from family " << presentQueueFamily << ", swap chain images are "
+                      << (concurrentSwapChainSharing ? "concurrent" : "exclusive with ownership transfers") << std::endl;
+        }
     }
 
-    // This function finds queue families available on the GPU
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
+    // This function finds queue families available on the GPU, from the snapshot taken in pickPhysicalDevice
+    QueueFamilyIndices findQueueFamilies(const DeviceCapabilities& deviceCapabilities) {
         QueueFamilyIndices indices;
-        // VkBool32 presentSupport = false;  <-- removed redundant outer variable
-
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-        int i = 0;
-        for (const auto& queueFamily : queueFamilies) {
-            // Query present support for this family (do it for every family)
-            VkBool32 presentSupport = VK_FALSE;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        // Without a surface there is nothing to present to, any graphics family will do
+        indices.presentRequired = !headless;
+
+        // Every family is looked at, the dedicated transfer and compute families can come after the graphics one
+        std::optional<uint32_t> computeTransferFamily; // compute + transfer without graphics, the fallback for transfers
+        const auto& queueFamilies = deviceCapabilities.queueFamilies;
+        for (uint32_t i = 0; i < queueFamilies.size(); i++) {
+            // Present support of every family was queried along with the rest of the snapshot
+            VkBool32 presentSupport = i < deviceCapabilities.presentSupport.size() ? deviceCapabilities.presentSupport[i] : VK_FALSE;
+            VkQueueFlags flags = queueFamilies[i].queueFlags;
+            bool graphics = flags & VK_QUEUE_GRAPHICS_BIT;
+            bool compute = flags & VK_QUEUE_COMPUTE_BIT;
+            // Graphics and compute families support transfers even when they don't say so
+            bool transfer = (flags & VK_QUEUE_TRANSFER_BIT) || graphics || compute;
+
+            if (graphics && !indices.graphicsFamily.has_value()) {
                 indices.graphicsFamily = i;
             }
-
-            if (presentSupport) {
+            // Prefer presenting from the graphics family, then no ownership transfer is needed before present
+            if (presentSupport && (!indices.presentFamily.has_value() || indices.graphicsFamily == i)) {
                 indices.presentFamily = i;
             }
-
-            if (indices.isComplete()) {
-                break;
+            if (transfer && !graphics && !compute && !indices.transferFamily.has_value()) {
+                indices.transferFamily = i; // the copy engine
             }
+            if (compute && !graphics && !indices.computeFamily.has_value()) {
+                indices.computeFamily = i;
+            }
+            if (transfer && compute && !graphics && !computeTransferFamily.has_value()) {
+                computeTransferFamily = i;
+            }
+        }
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = computeTransferFamily;
+        }
 
-            i++;
+        // VULK_PRESENT_FAMILY=i presents from family i when it can, e.g. to try the ownership transfers on a device
+        // whose graphics family presents as well
+        uint32_t forcedPresent = envUint("VULK_PRESENT_FAMILY", UINT32_MAX);
+        if (forcedPresent != UINT32_MAX && indices.presentRequired) {
+            uint32_t family = forcedPresent;
+            if (family < deviceCapabilities.presentSupport.size() && deviceCapabilities.presentSupport[family]) {
+                indices.presentFamily = family;
+            }
         }
 
         return indices;
     }
 
-    // Determines if a GPU is suitable by checking queue families only
-    bool isDeviceSuitable(VkPhysicalDevice device) {
-        QueueFamilyIndices indices = findQueueFamilies(device);
+    // Determines if a GPU is suitable by checking queue families, extensions and swap chain support
+    bool isDeviceSuitable(const DeviceCapabilities& deviceCapabilities) {
+        QueueFamilyIndices indices = findQueueFamilies(deviceCapabilities);
 
-        bool extensionsSupported = checkDeviceExtensionSupport(device);
+        bool extensionsSupported = checkDeviceExtensionSupport(deviceCapabilities);
         
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
-            SwapChainSupportDetails SwapChainSupport = querySwapChainSupport(device);
-            swapChainAdequate = !SwapChainSupport.formats.empty() && !SwapChainSupport.presentModes.empty(); // Are both the vectors not empty?
+        // Headless mode has no swap chain to check
+        bool swapChainAdequate = headless;
+        if (extensionsSupported && !headless) {
+            // Are both the vectors not empty?
+            swapChainAdequate = !deviceCapabilities.surfaceFormats.empty() && !deviceCapabilities.presentModes.empty();
         }
 
         return indices.isComplete() && extensionsSupported && swapChainAdequate;
     }
 
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
-        uint32_t extensionCount;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
-        for (const auto& extension : availableExtensions) {
-            //std::cout << "Erased Extension: " << extension.extensionName << std::endl;
-            requiredExtensions.erase(extension.extensionName);
+    bool checkDeviceExtensionSupport(const DeviceCapabilities& deviceCapabilities) {
+        for (const char* extension : requiredDeviceExtensions()) {
+            if (!deviceCapabilities.hasExtension(extension)) {
+                return false;
+            }
         }
+        return true;
+    }
 
-        return requiredExtensions.empty();
+    // deviceExtensions, or none at all in headless mode where there is no swap chain
+    std::vector<const char*> requiredDeviceExtensions() {
+        if (headless) {
+            return {};
+        }
+        return std::vector<const char*>(deviceExtensions.begin(), deviceExtensions.end());
     }
 
+
     // Selects a physical device (GPU) that supports Vulkan
     void pickPhysicalDevice() {
 
@@ -328,44 +1038,416 @@ private:
         std::vector<VkPhysicalDevice> devices(deviceCount);
         vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-        // Pick the first device that is suitable
-        for (const auto& device : devices) {
-            if (isDeviceSuitable(device)) {
-                physicalDevice = device;
-                break;
-            }
+        // Rank every suitable device rather than taking the first one, which is often the integrated GPU (see DeviceSelection.h).
+        // Each device is queried exactly once, into its capability snapshot
+        std::vector<DeviceCapabilities> allCapabilities;
+        std::vector<PhysicalDeviceCandidate> candidates;
+        uint32_t snapshotsFromDisk = 0;
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            allCapabilities.push_back(queryDeviceCapabilities(devices[i], headless ? VK_NULL_HANDLE : surface));
+            snapshotsFromDisk += allCapabilities.back().fromDisk ? 1 : 0;
+
+            PhysicalDeviceCandidate candidate = describePhysicalDevice(allCapabilities.back(), i);
+            candidate.suitable = isDeviceSuitable(allCapabilities.back());
+            candidates.push_back(std::move(candidate));
         }
+        rankPhysicalDevices(candidates);
 
-        if (physicalDevice == VK_NULL_HANDLE) {
+        // VULK_DEVICE=<index> or VULK_DEVICE=<uuid> forces a device, e.g. to benchmark the integrated GPU on purpose
+        const PhysicalDeviceCandidate* chosen = findRequestedDevice(candidates, envString("VULK_DEVICE"));
+        if (chosen != nullptr && !chosen->suitable) {
+            throw std::runtime_error("VULK_DEVICE picks " + chosen->name + ", which can't run this renderer!");
+        }
+        if (chosen == nullptr && candidates.front().suitable) {
+            chosen = &candidates.front();
+        }
+
+        if (chosen == nullptr) {
             throw std::runtime_error("Failed to find a suitable GPU!");
-        } else {
-            std::cout << "\n\tFound a compatible GPU device!\n";
         }
+        physicalDevice = chosen->device;
+        capabilities = std::move(allCapabilities[chosen->index]);
+        printDeviceRanking(candidates, *chosen);
+        std::cout << "\tDevice capabilities: " << snapshotsFromDisk << " of " << deviceCount << " loaded from snapshot files" << std::endl;
+        std::cout << "\tUsing " << chosen->name << (envString("VULK_DEVICE").empty() ? "" : " (forced by VULK_DEVICE)") << std::endl;
     }
 
     void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+        using clock = std::chrono::steady_clock;
+
+        // VULK_MAX_FRAMES=N renders N frames and exits, which keeps benchmark runs (e.g. under lavapipe) comparable.
+        // Headless runs have no window to close, so they stop after one frame unless told otherwise
+        const uint32_t frameLimit = envUint("VULK_MAX_FRAMES", headless ? 1 : 0);
+
+        uint64_t totalFrames = 0;
+        uint64_t intervalFrames = 0;
+        auto loopStart = clock::now();
+        auto intervalStart = loopStart;
+
+        while (headless || !glfwWindowShouldClose(window)) {
+            // Nothing to render into while minimized, sleep until the window comes back
+            if (!headless && windowMinimized()) {
+                glfwWaitEvents();
+                continue;
+            }
+
+            if (renderOnDemand && !frameNeeded()) {
+                {
+                    PROFILE_ZONE("idle");
+                    glfwWaitEventsTimeout(idlePollSeconds);
+                }
+                idleWakeups++;
+                // Presents don't signal anything the retirement can see. Nothing is queued while idle, so drain the
+                // present queue once and let the swap chains retired before the pause go
+                destroyRetired(!retiredSwapChains.empty() && vkQueueWaitIdle(presentQueue) == VK_SUCCESS);
+                updatePipelines();
+                if (!frameNeeded()) {
+                    // Time spent idle isn't frame time, and the next frame after it shouldn't look like a missed vblank
+                    intervalFrames = 0;
+                    intervalStart = clock::now();
+                    lastPresent = {};
+                    continue;
+                }
+            }
+
+            {
+                PROFILE_ZONE("frame");
+                if (!headless) {
+                    // Input is sampled by glfwPollEvents, the pacer holds it back until just in time (a no-op unless enabled)
+                    const FrameData& previousFrame = frames[(currentFrame + maxFramesInFlight - 1) % maxFramesInFlight];
+                    framePacer.beginFrame(swapChain, previousFrame.inFlightFence, timelineSync ? &graphicsTimeline : nullptr, previousFrame.timelineValue);
+                    glfwPollEvents();
+                }
+                updatePipelines();
+                // A frame that wasn't presented (the swap chain went out of date) still owes the scene its update
+                if (drawFrame()) {
+                    sceneDirty = false;
+                }
+            }
+            // Drain the per-thread rings while they are far from full
+            Profiler::collect();
+
+            totalFrames++;
+            intervalFrames++;
+
+            // Until the first frame is submitted (and queued for presentation), not until it's on screen
+            if (totalFrames == 1) {
+                std::cout << "\tTime to first frame: " << std::chrono::duration<double, std::milli>(clock::now() - processStart).count()
+                          << " ms since process start" << std::endl;
+            }
+
+            auto now = clock::now();
+            double intervalSeconds = std::chrono::duration<double>(now - intervalStart).count();
+            if (intervalSeconds >= 1.0) {
+                std::cout << "\t" << intervalFrames / intervalSeconds << " fps ("
+                          << 1000.0 * intervalSeconds / intervalFrames << " ms/frame)" << std::endl;
+                intervalFrames = 0;
+                intervalStart = now;
+            }
+
+            if (frameLimit != 0 && totalFrames >= frameLimit) {
+                break;
+            }
+        }
+
+        // drawFrame is asynchronous, so wait for the GPU to finish before cleanup starts destroying things
+        vkDeviceWaitIdle(device);
+
+        if (Profiler::enabled()) {
+            gpuProfiler.flush();
+            Profiler::writeChromeTrace(profilePath);
+        }
+
+        // VULK_READBACK=file.ppm saves the last headless frame, e.g. to compare against a golden image
+        std::string readbackPath = envString("VULK_READBACK");
+        if (headless && !readbackPath.empty() && totalFrames > 0) {
+            offscreenTarget.readback(commandPool, graphicsQueue, lastImageIndex, readbackPath);
+        }
+
+        double totalSeconds = std::chrono::duration<double>(clock::now() - loopStart).count();
+        if (totalFrames > 0 && totalSeconds > 0.0) {
+            std::cout << "\n\tRendered " << totalFrames << " frames in " << totalSeconds << " s: "
+                      << totalFrames / totalSeconds << " fps average with " << maxFramesInFlight << " frames in flight" << std::endl;
+        }
+        if (swapChainRecreations > 0) {
+            std::cout << "\tSwap chain recreated " << swapChainRecreations << " times" << std::endl;
+        }
+        framePacer.report();
+        if (renderOnDemand) {
+            std::cout << "\tRender on demand: " << totalFrames << " frames, " << idleWakeups << " idle wakeups" << std::endl;
+        }
+    }
+
+    // True when the frame was submitted and presented
+    bool drawFrame() {
+        if (headless) {
+            drawOffscreenFrame();
+            return true;
+        }
+
+        FrameData& frame = frames[currentFrame];
+
+        // Wait until the GPU is done with the last submission that used this slot of the ring
+        waitForFrame(frame);
+
+        // Resize events stop coming in once the user stops dragging
+        if (swapChainStale && (swapChainOutOfDate || std::chrono::steady_clock::now() - lastResize >= resizeDebounce)) {
+            recreateSwapChain();
+        }
+
+        uint32_t imageIndex;
+        VkResult result;
+        {
+            PROFILE_ZONE("acquire image");
+            result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // Nothing was acquired and the semaphore stays unsignaled, try again next frame with a new swap chain
+            recreateSwapChain();
+            return false;
+        } else if (result == VK_SUBOPTIMAL_KHR) {
+            // Still presentable, keep going and recreate once the size settles
+            markSwapChainStale();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to acquire swap chain image!");
+        }
+
+        // Only reset the fence once we know work is going to be submitted with it
+        if (!timelineSync) {
+            vkResetFences(device, 1, &frame.inFlightFence);
+        }
+
+        vkResetCommandBuffer(frame.commandBuffer, 0);
+        recordCommandBuffer(frame.commandBuffer, imageIndex);
+
+        VkSemaphore waitSemaphores[] = {frame.imageAvailableSemaphore};
+        // Vertex work can start right away, we only have to wait for the image before writing colors to it
+        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+
+        // The binary semaphore is for vkQueuePresentKHR, or for the ownership acquire when there is no timeline to wait on.
+        // The timeline value, when used, always goes last
+        std::vector<VkSemaphore> signalSemaphores;
+        std::vector<uint64_t> signalValues;
+        if (!timelineSync || !swapChainOwnershipTransfer) {
+            signalSemaphores.push_back(renderFinishedSemaphores[imageIndex]);
+            signalValues.push_back(0); // ignored for binary semaphores
+        }
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        if (timelineSync) {
+            frame.timelineValue = graphicsTimeline.nextValue();
+            signalSemaphores.push_back(graphicsTimeline.handle());
+            signalValues.push_back(frame.timelineValue);
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+            timelineInfo.pSignalSemaphoreValues = signalValues.data();
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = timelineSync ? &timelineInfo : nullptr;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+        {
+            PROFILE_ZONE("submit");
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit draw command buffer!");
+            }
+        }
+
+        // With exclusive images on two families, the present family acquires the image before presenting it
+        VkSemaphore presentWaitSemaphore = renderFinishedSemaphores[imageIndex];
+        if (swapChainOwnershipTransfer) {
+            PROFILE_ZONE("acquire image ownership");
+            // Waits on this frame's graphics timeline value when there is one, a cross-queue wait needs nothing else
+            VkSemaphore acquireWaitSemaphore = timelineSync ? graphicsTimeline.handle() : renderFinishedSemaphores[imageIndex];
+            VkPipelineStageFlags acquireWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            VkTimelineSemaphoreSubmitInfo acquireTimelineInfo{};
+            acquireTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            acquireTimelineInfo.waitSemaphoreValueCount = 1;
+            acquireTimelineInfo.pWaitSemaphoreValues = &frame.timelineValue;
+            VkSubmitInfo acquireInfo{};
+            acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            acquireInfo.pNext = timelineSync ? &acquireTimelineInfo : nullptr;
+            acquireInfo.waitSemaphoreCount = 1;
+            acquireInfo.pWaitSemaphores = &acquireWaitSemaphore;
+            acquireInfo.pWaitDstStageMask = &acquireWaitStage;
+            acquireInfo.commandBufferCount = 1;
+            acquireInfo.pCommandBuffers = &presentAcquireCommandBuffers[imageIndex];
+            acquireInfo.signalSemaphoreCount = 1;
+            acquireInfo.pSignalSemaphores = &presentAcquiredSemaphores[imageIndex];
+            if (vkQueueSubmit(presentQueue, 1, &acquireInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit swap chain image acquire!");
+            }
+            presentWaitSemaphore = presentAcquiredSemaphores[imageIndex];
+        }
+
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.pNext = framePacer.presentId(swapChain);
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &presentWaitSemaphore;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &swapChain;
+        presentInfo.pImageIndices = &imageIndex;
+
+        {
+            PROFILE_ZONE("present");
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+        frame.submitNumber = frameNumber + 1;
+        bool presented = result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+        // The frame was submitted either way, only the present may not have happened. Recreate at the start of the next frame,
+        // after frameNumber moved on: the retired swap chain must outlive this frame too
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            markSwapChainStale();
+            swapChainOutOfDate = true;
+        } else if (result == VK_SUBOPTIMAL_KHR) {
+            markSwapChainStale();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swap chain image!");
+        }
+
+        // The adaptive present mode watches the time between presents, a switch recreates the swap chain like a resize
+        if (presentPolicy.adaptive()) {
+            auto now = std::chrono::steady_clock::now();
+            if (lastPresent != std::chrono::steady_clock::time_point{} &&
+                presentPolicy.framePresented(std::chrono::duration<double, std::milli>(now - lastPresent).count())) {
+                markSwapChainStale();
+            }
+            lastPresent = now;
+        }
+
+        currentFrame = (currentFrame + 1) % maxFramesInFlight;
+        frameNumber++;
+        return presented;
+    }
+
+    // Headless frame: the image belongs to this frame slot, so the frame wait is all the synchronization it needs.
+    // No acquire and no present, the frame rate is what the GPU can render
+    void drawOffscreenFrame() {
+        FrameData& frame = frames[currentFrame];
+        waitForFrame(frame);
+        if (!timelineSync) {
+            vkResetFences(device, 1, &frame.inFlightFence);
+        }
+
+        uint32_t imageIndex = currentFrame;
+        vkResetCommandBuffer(frame.commandBuffer, 0);
+        recordCommandBuffer(frame.commandBuffer, imageIndex);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        VkSemaphore timelineSemaphore = graphicsTimeline.handle();
+        if (timelineSync) {
+            frame.timelineValue = graphicsTimeline.nextValue();
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &frame.timelineValue;
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &timelineSemaphore;
+        }
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+
+        frame.submitNumber = frameNumber + 1;
+        lastImageIndex = imageIndex;
+        currentFrame = (currentFrame + 1) % maxFramesInFlight;
+        frameNumber++;
+    }
+
+    // Blocks until the previous submit from this frame slot has finished on the GPU
+    void waitForFrame(FrameData& frame) {
+        PROFILE_ZONE("wait for frame");
+        if (timelineSync) {
+            graphicsTimeline.wait(frame.timelineValue);
+        } else {
+            vkWaitForFences(device, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
         }
     }
 
     void cleanup() {
-        for (auto& imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
+        for (auto& retired : retiredSwapChains) {
+            destroySwapChainResources(retired);
+        }
+        for (auto& frame : frames) {
+            vkDestroySemaphore(device, frame.imageAvailableSemaphore, nullptr);
+            vkDestroyFence(device, frame.inFlightFence, nullptr);
+        }
+        graphicsTimeline.destroy();
+        for (auto semaphore : renderFinishedSemaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        destroyOwnershipTransferCommands();
+
+        // Destroying the pool frees the command buffers allocated from it
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        vkDestroyCommandPool(device, presentCommandPool, nullptr);
+        vkDestroyCommandPool(device, transferCommandPool, nullptr);
+        vkDestroyCommandPool(device, computeCommandPool, nullptr);
+
+        for (auto framebuffer : swapChainFramebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+
+        // Let queued builds finish before destroying their pipelines, modules and the cache they go through
+        shaderWatcher.stop();
+        pipelineBuilder.stop();
+        for (auto& retired : retiredPipelines) {
+            vkDestroyPipeline(device, retired.pipeline, nullptr);
+        }
+        for (auto& retired : retiredPrograms) {
+            destroyShaderProgram(*retired.program);
+        }
+        if (pendingProgram) {
+            destroyShaderProgram(*pendingProgram);
+        }
+        destroyShaderProgram(*program);
+        gpuProfiler.destroy();
+        pipelineLibrary.destroy();
+        shaderObjects.destroy();
+        moduleCache.destroy();
+        pipelineCache.save();
+        pipelineCache.destroy();
+        layoutCache.destroy();
+        vkDestroyRenderPass(device, renderPass, nullptr);
+
+        if (headless) {
+            offscreenTarget.destroy();
+        } else {
+            for (auto& imageView : swapChainImageViews) {
+                vkDestroyImageView(device, imageView, nullptr);
+            }
+            vkDestroySwapchainKHR(device, swapChain, nullptr);
         }
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
 
         if (enableValidationLayers) {
             DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
         }
         vkDestroyDevice(device, nullptr);
 
-        // Comes before the instance destruction (destroys the glfw surface)
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!headless) {
+            // Comes before the instance destruction (destroys the glfw surface)
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
 
         vkDestroyInstance(instance, nullptr);
-        glfwDestroyWindow(window);
-        glfwTerminate();
+        if (!headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
     }
 
 // =============== INSTANCE CREATION + DEBUG MESSENGER ====================
@@ -475,8 +1557,9 @@ private:
 
     // Required instance extensions
     std::vector<const char*> getRequiredExtensions() {
+        // The surface extensions GLFW asks for are only needed with a window
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        const char** glfwExtensions = headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
         std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
@@ -488,25 +1571,13 @@ private:
     }
 
     // Swap chain
-    // Function to populate the struct
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
+    // Function to populate the struct. Formats and present modes come from the capability snapshot, the surface
+    // capabilities are queried fresh because currentExtent follows the window size
+    SwapChainSupportDetails querySwapChainSupport() {
         SwapChainSupportDetails details;
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-        
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
-        if (formatCount != 0) {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
-        }
-
-        uint32_t presentModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
-        if (presentModeCount != 0) {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
-        }
-
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &details.capabilities);
+        details.formats = capabilities.surfaceFormats;
+        details.presentModes = capabilities.presentModes;
         return details;
     }
 
@@ -522,14 +1593,9 @@ private:
         return availableFormats[0];
     }
 
-    // Presentation mode
+    // Presentation mode, MAILBOX when available and FIFO otherwise unless VULK_PRESENT_MODE says differently
     VkPresentModeKHR chooseSwapPresentMode(std::vector<VkPresentModeKHR>& availablePresentModes) {
-        for (const auto& availablePresentMode : availablePresentModes) {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return availablePresentMode;
-            }
-        }
-        return VK_PRESENT_MODE_FIFO_KHR;
+        return presentPolicy.choose(availablePresentModes);
     }
 
     // Swap Extent
@@ -556,7 +1622,7 @@ private:
     }
 
     void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport();
 
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
@@ -565,12 +1631,8 @@ private:
         // Aside from these properties, we also have to decide how many images we would like to have in the swap chain
         //uint32_t imageCount = swapChainSupport.capabilities.minImageCount;
         // If we simply stick to this minimum means that we may sometimes have to wait on the driver to complete internal operations before
-        // we can acquire another image to render to. So, we request one more image than the minimum
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-
-        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
+        // we can acquire another image to render to. How many more depends on the present mode, see PresentModePolicy::imageCount
+        uint32_t imageCount = presentPolicy.imageCount(presentMode, swapChainSupport.capabilities);
 
         VkSwapchainCreateInfoKHR createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -585,39 +1647,58 @@ private:
         // Specifies what kind of we'll use the images in the swap chain for
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-        QueueFamilyIndices indices  = findQueueFamilies(physicalDevice);
+        QueueFamilyIndices indices  = findQueueFamilies(capabilities);
         uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
-        if (indices.graphicsFamily != indices.presentFamily) {
+        if (indices.graphicsFamily != indices.presentFamily && concurrentSwapChainSharing) {
             createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
             createInfo.queueFamilyIndexCount = 2;
             createInfo.pQueueFamilyIndices = queueFamilyIndices;
         } else {
+            // Two families and exclusive images: every frame transfers the image to the present family, see drawFrame
             createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
             createInfo.queueFamilyIndexCount = 0;
             createInfo.pQueueFamilyIndices = nullptr;
         }
+        swapChainOwnershipTransfer = indices.graphicsFamily != indices.presentFamily && !concurrentSwapChainSharing;
 
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; // no transformation
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // On recreation the current swap chain is handed over, the presentation engine can reuse its resources.
+        // It is retired by recreateSwapChain, not destroyed here
+        createInfo.oldSwapchain = swapChain;
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+        VkSwapchainKHR newSwapChain;
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &newSwapChain) != VK_SUCCESS) {
             throw std::runtime_error("\n\tCould not create SwapChain!");
-        } else {
+        } else if (swapChain == VK_NULL_HANDLE) {
             std::cout << "\n\tSwap Chain creation successful!" << std::endl;
         }
+        swapChain = newSwapChain;
 
         vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
         swapChainImages.resize(imageCount);
         vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+        // The driver may create more images than asked for
+        std::cout << "\tPresent mode " << PresentModePolicy::name(presentMode) << " with " << imageCount << " images, "
+                  << extent.width << "x" << extent.height << std::endl;
 
         swapChainImageFormat = surfaceFormat.format;
         swapChainExtent = extent;
     }
 
+    // Headless stand-in for createSwapChain + createImageViews. The rest of the renderer only sees the image views and the extent
+    void createOffscreenTarget() {
+        // Same format the swap chain prefers, so headless frames match what a window would show
+        swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+        swapChainExtent = {WIDTH, HEIGHT};
+        offscreenTarget.create(capabilities, device, swapChainImageFormat, swapChainExtent, maxFramesInFlight);
+        swapChainImages = offscreenTarget.images();
+        swapChainImageViews = offscreenTarget.imageViews();
+    }
+
     // image view
     void createImageViews() {
         swapChainImageViews.resize(swapChainImages.size());
@@ -647,64 +1728,1081 @@ private:
         }
     }
 
+    // Render pass
+    void createRenderPass() {
+        // A single color attachment backed by the swap chain image
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // clear to black at the start of every frame
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // keep the result so it can be presented
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // we don't care about the previous contents
+        // Ready to present, or in headless mode ready to be copied out by OffscreenTarget::readback
+        colorAttachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentReference colorAttachmentRef{};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+
+        // The image layout transition at the start of the render pass must not happen before the image is acquired.
+        // The image-available semaphore is waited on at COLOR_ATTACHMENT_OUTPUT, so make the subpass wait on that stage too
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.srcAccessMask = 0;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        // The final layout transition must be done before the barrier that releases the image to the present family
+        // (see recordCommandBuffer). The implicit dependency at the end of the render pass only reaches BOTTOM_OF_PIPE
+        VkSubpassDependency releaseDependency{};
+        releaseDependency.srcSubpass = 0;
+        releaseDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        releaseDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        releaseDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        releaseDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        releaseDependency.dstAccessMask = 0;
+
+        VkSubpassDependency dependencies[] = {dependency, releaseDependency};
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &colorAttachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 2;
+        renderPassInfo.pDependencies = dependencies;
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create render pass!");
+        }
+    }
+
     // Graphics pipeline
     void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("../shaders/vert.spv");
-        auto fragShaderCode = readFile("../shaders/frag.spv");
+       /*
+       Pipelines are compiled on a pool of worker threads that all go through pipelineCache.
+       # VULK_PIPELINE_WORKERS sets the pool size, by default one worker per hardware thread.
+       # VULK_PREFETCH_SPECIALIZATIONS="key;key;..." queues extra variants at startup. They compile in the background,
+         only the variant used for the first frame is waited on.
+       # With the graphics pipeline library, variants are fast-linked from cached parts and an optimized link
+         replaces them once it is done (see upgradeLinkedPipelines).
+       */
+       pipelineLibrary.init(device, pipelineCache.get());
+       pipelineBuilder.start(device, pipelineCache.get(), envUint("VULK_PIPELINE_WORKERS", 0), pipelineLibraryEnabled ? &pipelineLibrary : nullptr);
+       std::cout << "\tPipeline build workers: " << pipelineBuilder.workerCount() << " ("
+                 << (pipelineCache.loadedFromDisk() ? "warm" : "cold") << " cache)" << std::endl;
+
+       // The code and its reflection were loaded on a startup worker (see initVulkan), what's left needs the device
+       initShaderProgram(*program);
+       std::cout << "\tShader module cache: " << moduleCache.hits() << " hits, " << moduleCache.misses() << " misses" << std::endl;
+
+       // VULK_SPECIALIZATION="id=value,..." picks the startup variant, e.g. to compare folded branches against the defaults
+       activeSpecialization = SpecializationKey::parse(envString("VULK_SPECIALIZATION"));
+       if (shaderObjectsEnabled) {
+           // The shader objects are all that is drawn with, raster state permutations need nothing of their own
+           requestShaderObjects(*program);
+           activeShaderObjects = program->shaderObjectBuild.get();
+       } else {
+           createPipelineVariants();
+       }
+
+       // VULK_PIPELINE_BENCH=N compiles N copies of the startup pipeline serially and then in parallel
+       uint32_t benchCount = envUint("VULK_PIPELINE_BENCH", 0);
+       if (benchCount > 0) {
+           benchmarkPipelineBuilds(currentVariantKey(), benchCount);
+       }
+
+       // VULK_HOT_RELOAD=1 recompiles shader sources as they are saved and swaps the result in while running
+       if (envFlag("VULK_HOT_RELOAD")) {
+           startShaderWatcher();
+       }
+    }
+
+    // The startup variant, waited for, and the VULK_PREFETCH_SPECIALIZATIONS ones, left compiling in the background
+    void createPipelineVariants() {
+        program->variants.request(currentVariantKey());
+
+        std::string prefetch = envString("VULK_PREFETCH_SPECIALIZATIONS");
+        for (size_t start = 0; start < prefetch.size();) {
+            size_t end = prefetch.find(';', start);
+            if (end == std::string::npos) {
+                end = prefetch.size();
+            }
+            if (end > start) {
+                program->variants.request({SpecializationKey::parse(prefetch.substr(start, end - start)), canonicalRasterState(rasterState, dynamicRaster.mask())});
+            }
+            start = end + 1;
+        }
+
+        graphicsPipeline = getPipelineVariant(currentVariantKey());
+    }
+
+    std::unique_ptr<ShaderProgram> createShaderProgram(std::shared_ptr<const SpirvBlob> vertCode, std::shared_ptr<const SpirvBlob> fragCode) {
+        std::unique_ptr<ShaderProgram> shaderProgram = loadShaderProgram(std::move(vertCode), std::move(fragCode));
+        initShaderProgram(*shaderProgram);
+        return shaderProgram;
+    }
+
+    // The device independent half of createShaderProgram: takes the code and reflects it. Safe to run on any thread
+    std::unique_ptr<ShaderProgram> loadShaderProgram(std::shared_ptr<const SpirvBlob> vertCode, std::shared_ptr<const SpirvBlob> fragCode) {
+        auto shaderProgram = std::make_unique<ShaderProgram>();
+        shaderProgram->vertShaderCode = std::move(vertCode);
+        shaderProgram->fragShaderCode = std::move(fragCode);
+
+        // Entry points, stage I/O, descriptor bindings and push constants come from the bytecode itself (see SpirvReflect.h)
+        const SpirvBlob& vert = *shaderProgram->vertShaderCode;
+        const SpirvBlob& frag = *shaderProgram->fragShaderCode;
+        shaderProgram->vertReflection = reflectSpirv(vert.words(), vert.wordCount());
+        shaderProgram->fragReflection = reflectSpirv(frag.words(), frag.wordCount());
+        if (shaderProgram->vertReflection.entryPoints.empty() || shaderProgram->fragReflection.entryPoints.empty()) {
+            throw std::runtime_error("Shader module has no entry point!");
+        }
+        return shaderProgram;
+    }
 
+    // Modules, pipeline layout and the variant cache of a loaded program
+    void initShaderProgram(ShaderProgram& shaderProgram) {
         /*
         Shader modules are just a thin wrapper around the shader bytecode that we've loaded from a file
         and the functions defined in it. The compilation and linking of the SPIR-V to machine code for execution
         by the GPU does not happen until the Graphics pipeline is created.
-        # We can destroy our modules right after the creation of the pipeline as they would no longer be needed so we can just keep them as local variables
         */
-       VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-       VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        shaderProgram.vertShaderModule = createShaderModule(shaderProgram.vertShaderCode);
+        shaderProgram.fragShaderModule = createShaderModule(shaderProgram.fragShaderCode);
 
-       /*
-       To actually use the shaders we will need to assign them to a specific stage through VkPipelineShaderStageCreateInfo struct as part 
-       of thr actual pipeline creation process.
-       */
-      VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-      vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-      // Specifies in which pipeline stage the shader is gonna be used.
-      vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-      vertShaderStageInfo.module = vertShaderModule; // Specifies the shader module containing the code
-      vertShaderStageInfo.pName = "main"; // Which function to invoke (entrypoint)
-      vertShaderStageInfo.pSpecializationInfo = nullptr; // Allows you to specify values for shader constants
+        // Descriptor sets and push constant ranges of both stages, merged. The layout is owned by layoutCache
+        shaderProgram.pipelineLayout = layoutCache.getPipelineLayout(
+            buildPipelineLayoutDesc({&shaderProgram.vertReflection, &shaderProgram.fragReflection}));
+
+        ShaderProgram* source = &shaderProgram;
+        shaderProgram.variants.init(device, [this, source](const PipelineVariantKey& key) {
+            if (!pipelineLibraryEnabled) {
+                return pipelineBuilder.submit(makePipelineDesc(*source, key));
+            }
+            // Queued behind the fast link, so the parts it needs are already being compiled by then
+            std::shared_future<VkPipeline> fastLinked = pipelineBuilder.submit(makePipelineDesc(*source, key), PipelineLinkMode::FastLink);
+            source->upgrades.push_back({key, pipelineBuilder.submit(makePipelineDesc(*source, key), PipelineLinkMode::OptimizedLink)});
+            return fastLinked;
+        });
+    }
+
+    // Waits for builds still running on the workers, destroys the pipelines and the library parts and shader objects no
+    // other program uses, then drops the program's module references. A module is destroyed once no other program shares it
+    void destroyShaderProgram(ShaderProgram& shaderProgram) {
+        shaderProgram.variants.destroy();
+        for (auto& upgrade : shaderProgram.upgrades) {
+            try {
+                vkDestroyPipeline(device, upgrade.optimized.get(), nullptr);
+            } catch (const std::exception&) {
+            }
+        }
+        shaderProgram.upgrades.clear();
+        // Retired programs get here once their retirePoint() was reached, so nothing linked from these parts is in flight
+        for (VkPipeline part : pipelineLibrary.release(&shaderProgram)) {
+            vkDestroyPipeline(device, part, nullptr);
+        }
+        if (shaderProgram.shaderObjectBuild.valid()) {
+            shaderProgram.shaderObjectBuild.wait(); // a build still running would hand out shaders after releaseOwner
+        }
+        shaderObjects.releaseOwner(&shaderProgram);
+        shaderProgram.fragShaderModule.reset();
+        shaderProgram.vertShaderModule.reset();
+    }
+
+    // True when nothing of the program is still being compiled, so destroying it would not block
+    bool shaderProgramIdle(const ShaderProgram& shaderProgram) {
+        for (const auto& upgrade : shaderProgram.upgrades) {
+            if (upgrade.optimized.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return false;
+            }
+        }
+        if (shaderProgram.shaderObjectBuild.valid() &&
+            shaderProgram.shaderObjectBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        return shaderProgram.variants.idle();
+    }
+
+    void startShaderWatcher() {
+#ifdef VULK_GLSLC
+        std::string glslc = envString("GLSLC", VULK_GLSLC);
+#else
+        std::string glslc = envString("GLSLC", "glslc");
+#endif
+        std::string sourceDir = shaderSourceDirectory();
+        shaderWatcher.start(sourceDir, glslc);
+        std::cout << "\tHot reload: watching " << sourceDir << " (compiling with " << glslc << ")" << std::endl;
+    }
+
+    // Pipeline housekeeping at the frame boundary, called before every drawFrame. Never waits on a compile
+    void updatePipelines() {
+        PROFILE_ZONE("updatePipelines");
+        destroyRetired();
+        if (shaderWatcher.running()) {
+            updateShaderReload();
+        }
+        if (pendingRasterState) {
+            updateRasterState();
+        }
+        if (pipelineLibraryEnabled) {
+            upgradeLinkedPipelines();
+        }
+    }
 
-      VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-      fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-      fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-      fragShaderStageInfo.module = fragShaderModule;
-      fragShaderStageInfo.pName = "main";
+    // Swaps in the raster state of the last key press once its variant is built. A failed build keeps the current state
+    void updateRasterState() {
+        if (pendingRasterPipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
 
-      VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        RasterState next = *pendingRasterState;
+        std::shared_future<VkPipeline> built = std::move(pendingRasterPipeline);
+        pendingRasterState.reset();
+        try {
+            graphicsPipeline = built.get();
+        } catch (const std::exception& e) {
+            std::cerr << "Raster state " << next.toString() << ": " << e.what() << ", keeping " << rasterState.toString() << std::endl;
+            return;
+        }
+        rasterState = next;
+        markDirty();
+        if (pendingProgram) {
+            // A hot reload still compiling has to come up with the new state as well
+            pendingPipeline = pendingProgram->variants.request(currentVariantKey());
+        }
+        std::cout << "Raster state " << rasterState.toString() << " (" << program->variants.size() << " pipeline variants)" << std::endl;
+    }
 
-       vkDestroyShaderModule(device, fragShaderModule, nullptr);
-       vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    /*
+    Pipelines, programs and swap chains that were swapped out are retired rather than destroyed: frames already submitted may still reference them.
+    They remember retirePoint() and go once the GPU has finished everything submitted up to it, whether or not more frames follow
+    (render on demand may not draw again for a long time).
+    # With timeline semaphores that is the last submitted graphics value.
+    # With fences it is the number of frames submitted. Each frame slot only has its latest submit pending, the earlier ones were
+      waited on before the slot was reused, so the fences of the slots whose latest submit is at or before the point tell.
+    # Swap chains also have presents and ownership acquires on presentQueue, which neither covers. They wait until
+      maxFramesInFlight more frames went through, or until presentQueue was drained while idle.
+    */
+    uint64_t retirePoint() const {
+        return timelineSync ? graphicsTimeline.lastSubmitted() : frameNumber;
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
+    bool retirePointReached(uint64_t point) {
+        if (timelineSync) {
+            return graphicsTimeline.reached(point);
+        }
+        for (const FrameData& frame : frames) {
+            if (frame.submitNumber != 0 && frame.submitNumber <= point && vkGetFenceStatus(device, frame.inFlightFence) != VK_SUCCESS) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void destroyRetired(bool presentQueueIdle = false) {
+        for (auto it = retiredSwapChains.begin(); it != retiredSwapChains.end();) {
+            bool presentsDone = presentQueueIdle || frameNumber >= it->retiredAtFrame + maxFramesInFlight;
+            if (presentsDone && retirePointReached(it->retiredAt)) {
+                destroySwapChainResources(*it);
+                it = retiredSwapChains.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto it = retiredPipelines.begin(); it != retiredPipelines.end();) {
+            if (retirePointReached(it->retiredAt)) {
+                vkDestroyPipeline(device, it->pipeline, nullptr);
+                it = retiredPipelines.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto it = retiredPrograms.begin(); it != retiredPrograms.end();) {
+            if (retirePointReached(it->retiredAt) && shaderProgramIdle(*it->program)) {
+                destroyShaderProgram(*it->program);
+                it = retiredPrograms.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Swaps fast-linked variants of the current program for their optimized links as those finish
+    void upgradeLinkedPipelines() {
+        for (auto it = program->upgrades.begin(); it != program->upgrades.end();) {
+            auto notReady = [](const std::shared_future<VkPipeline>& future) {
+                return future.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+            };
+            if (notReady(it->optimized) || notReady(program->variants.request(it->key))) {
+                ++it;
+                continue;
+            }
+
+            try {
+                VkPipeline optimized = it->optimized.get();
+                try {
+                    retiredPipelines.push_back({program->variants.replace(it->key, optimized), retirePoint()});
+                } catch (...) {
+                    vkDestroyPipeline(device, optimized, nullptr);
+                    throw;
+                }
+                if (it->key == currentVariantKey()) {
+                    graphicsPipeline = optimized;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Optimized link of " << it->key.toString() << " failed: " << e.what() << std::endl;
+            }
+            it = program->upgrades.erase(it);
+        }
+    }
+
+    /*
+    Hot reload, called from updatePipelines while the shader watcher runs.
+    # Freshly compiled stages are combined with the unchanged ones into a new program, its active variant (or its shader objects
+      in shader object mode) is queued on the build workers.
+    # Once that build is ready the new program replaces the current one, which is retired. A failed build leaves the current one in place.
+    */
+    void updateShaderReload() {
+        std::vector<ShaderWatcher::Update> updates = shaderWatcher.takeUpdates();
+        if (!updates.empty()) {
+            // Build on top of a reload that is still compiling so its changes aren't lost
+            const ShaderProgram& base = pendingProgram ? *pendingProgram : *program;
+            std::shared_ptr<const SpirvBlob> vertCode = base.vertShaderCode;
+            std::shared_ptr<const SpirvBlob> fragCode = base.fragShaderCode;
+            for (auto& update : updates) {
+                if (update.name == "vert.spv") {
+                    vertCode = std::make_shared<SpirvBlob>(std::move(update.code));
+                } else if (update.name == "frag.spv") {
+                    fragCode = std::make_shared<SpirvBlob>(std::move(update.code));
+                }
+            }
+
+            try {
+                std::unique_ptr<ShaderProgram> reloaded = createShaderProgram(vertCode, fragCode);
+                if (pendingProgram) {
+                    retiredPrograms.push_back({std::move(pendingProgram), retirePoint()});
+                }
+                pendingProgram = std::move(reloaded);
+                if (shaderObjectsEnabled) {
+                    requestShaderObjects(*pendingProgram);
+                } else {
+                    pendingPipeline = pendingProgram->variants.request(currentVariantKey());
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Hot reload: " << e.what() << ", keeping the previous shaders" << std::endl;
+            }
+        }
+
+        const auto ready = [](const auto& future) { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; };
+        if (pendingProgram && (shaderObjectsEnabled ? ready(pendingProgram->shaderObjectBuild) : ready(pendingPipeline))) {
+            try {
+                // Everything that can throw comes first, the current program stays untouched until the new one is complete
+                VkPipeline nextPipeline = VK_NULL_HANDLE;
+                ShaderObjectSet nextShaderObjects;
+                std::shared_future<VkPipeline> nextRasterPipeline;
+                if (shaderObjectsEnabled) {
+                    nextShaderObjects = pendingProgram->shaderObjectBuild.get();
+                } else {
+                    nextPipeline = pendingPipeline.get();
+                    if (pendingRasterState) {
+                        // A key press still waiting for its variant has to get it from the new program
+                        nextRasterPipeline = pendingProgram->variants.request(variantKeyFor(*pendingRasterState));
+                    }
+                }
+
+                graphicsPipeline = nextPipeline;
+                activeShaderObjects = std::move(nextShaderObjects);
+                if (nextRasterPipeline.valid()) {
+                    pendingRasterPipeline = std::move(nextRasterPipeline);
+                }
+                retiredPrograms.push_back({std::move(program), retirePoint()});
+                program = std::move(pendingProgram);
+                markDirty();
+                std::cout << "Hot reload: swapped in the new shaders at frame " << frameNumber << " (shader module cache: "
+                          << moduleCache.hits() << " hits, " << moduleCache.misses() << " misses)" << std::endl;
+            } catch (const std::exception& e) {
+                std::cerr << "Hot reload: " << e.what() << ", keeping the previous shaders" << std::endl;
+                retiredPrograms.push_back({std::move(pendingProgram), retirePoint()});
+            }
+            pendingPipeline = {};
+        }
+    }
+
+    // Returns the pipeline for these specialization-constant values and raster state, building it the first time it is asked for
+    VkPipeline getPipelineVariant(const PipelineVariantKey& key) {
+        return program->variants.get(key);
+    }
+
+    // Queues the shader objects for a program and the active specialization on the build workers.
+    // Raster state is recorded per draw, so it isn't part of them
+    void requestShaderObjects(ShaderProgram& shaderProgram) {
+        shaderProgram.shaderObjectBuild = pipelineBuilder.submitShaderObjects(makePipelineDesc(shaderProgram, currentVariantKey()), shaderObjects);
+    }
+
+    // The variant drawing uses right now. Dynamic groups of rasterState are left out, they don't need a pipeline of their own
+    PipelineVariantKey currentVariantKey() const {
+        return variantKeyFor(rasterState);
+    }
+
+    PipelineVariantKey variantKeyFor(const RasterState& raster) const {
+        return {activeSpecialization, canonicalRasterState(raster, dynamicRaster.mask())};
+    }
+
+    // Everything that makes up our one pipeline, as a value that can be handed to a build worker
+    GraphicsPipelineDesc makePipelineDesc(const ShaderProgram& shaderProgram, const PipelineVariantKey& key) {
+        GraphicsPipelineDesc desc{};
+        desc.name = "triangle";
+        desc.stages = {
+            {shaderProgram.vertShaderModule, &shaderProgram.vertReflection, 0},
+            {shaderProgram.fragShaderModule, &shaderProgram.fragReflection, 0}
+        };
+        desc.specialization = key.specialization;
+        desc.raster = key.raster;
+        desc.dynamicRaster = dynamicRaster.mask();
+        desc.layout = shaderProgram.pipelineLayout;
+        desc.renderPass = renderPass;
+        desc.subpass = 0;
+        desc.owner = &shaderProgram;
+        return desc;
+    }
+
+    /*
+    Serial vs. parallel pipeline compilation.
+    # Both runs build without a VkPipelineCache, otherwise every build after the first one would be a cache hit
+      and we'd only be measuring the lookup.
+    # Drivers keep their own on-disk shader cache as well, run with MESA_SHADER_CACHE_DISABLE=true
+      (or the vendor equivalent) for cold numbers.
+    # Drivers also remember what they compiled earlier in the process. Every pipeline gets its own value of an integer
+      specialization constant when the shaders declare one, so no build is a repeat of another.
+    # One untimed build warms up the driver first, then the passes run twice in alternating order and are averaged,
+      so neither side always gets the colder start.
+    */
+    void benchmarkPipelineBuilds(const PipelineVariantKey& key, uint32_t count) {
+        const SpirvSpecConstant* varied = nullptr;
+        for (const ShaderReflection* stage : {&program->vertReflection, &program->fragReflection}) {
+            for (const auto& constant : stage->specConstants) {
+                if (varied == nullptr && (constant.kind == SpirvSpecConstant::Kind::Int || constant.kind == SpirvSpecConstant::Kind::UInt)) {
+                    varied = &constant;
+                }
+            }
+        }
+        if (varied == nullptr) {
+            std::cout << "\tPipeline build benchmark: the shaders have no integer specialization constant to vary, "
+                         "repeated builds may hit the driver's in-process cache" << std::endl;
+        }
+
+        uint32_t nextValue = 0;
+        auto nextDesc = [&]() {
+            PipelineVariantKey distinct = key;
+            if (varied != nullptr) {
+                distinct.specialization.setInt(varied->constantId, static_cast<int32_t>(nextValue++));
+            }
+            return makePipelineDesc(*program, distinct);
+        };
+
+        std::vector<VkPipeline> pipelines;
+        pipelines.reserve(count * 4 + 1);
+        pipelines.push_back(buildGraphicsPipeline(device, VK_NULL_HANDLE, nextDesc()));
+
+        PipelineBuildService benchBuilder;
+        benchBuilder.start(device, VK_NULL_HANDLE, pipelineBuilder.workerCount());
+
+        auto serialPass = [&]() {
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < count; i++) {
+                pipelines.push_back(buildGraphicsPipeline(device, VK_NULL_HANDLE, nextDesc()));
+            }
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        auto parallelPass = [&]() {
+            std::vector<GraphicsPipelineDesc> descs;
+            for (uint32_t i = 0; i < count; i++) {
+                descs.push_back(nextDesc());
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::shared_future<VkPipeline>> futures = benchBuilder.submitBatch(descs);
+            for (auto& future : futures) {
+                pipelines.push_back(future.get());
+            }
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        double serialMs = serialPass();
+        double parallelMs = parallelPass();
+        parallelMs = (parallelMs + parallelPass()) / 2.0;
+        serialMs = (serialMs + serialPass()) / 2.0;
+        uint32_t benchWorkers = benchBuilder.workerCount();
+        benchBuilder.stop();
+
+        for (auto pipeline : pipelines) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+
+        std::cout << "Pipeline build benchmark (" << count << " pipelines):\n"
+                  << "\tserial:   " << serialMs << " ms\n"
+                  << "\tparallel: " << parallelMs << " ms on " << benchWorkers << " workers\n"
+                  << "\tspeedup:  " << serialMs / parallelMs << "x" << std::endl;
+    }
+
+    /*
+    Pipelines vs. shader objects, for the current program.
+    # Compile: count fresh pipelines without a VkPipelineCache against count fresh sets of shader objects (which have no cache).
+    # Bind: CPU time to record count bind + state + draw sequences into a command buffer that is never submitted.
+      The pipeline side binds the pipeline and sets what it left dynamic, the shader object side binds the stages and sets everything.
+    # The same objects are bound every time, drivers that skip redundant binds flatter both sides equally.
+    */
+    void benchmarkShaderObjects(uint32_t count) {
+        GraphicsPipelineDesc desc = makePipelineDesc(*program, currentVariantKey());
+
+        auto pipelineStart = std::chrono::steady_clock::now();
+        std::vector<VkPipeline> pipelines;
+        for (uint32_t i = 0; i < count; i++) {
+            pipelines.push_back(buildGraphicsPipeline(device, VK_NULL_HANDLE, desc));
+        }
+        double pipelineCompileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+
+        auto shaderObjectStart = std::chrono::steady_clock::now();
+        std::vector<ShaderObjectSet> sets;
+        for (uint32_t i = 0; i < count; i++) {
+            sets.push_back(shaderObjects.build(desc));
+        }
+        double shaderObjectCompileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderObjectStart).count();
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate benchmark command buffer!");
+        }
+
+        VkViewport viewport{0.0f, 0.0f, static_cast<float>(swapChainExtent.width), static_cast<float>(swapChainExtent.height), 0.0f, 1.0f};
+        VkRect2D scissor{{0, 0}, swapChainExtent};
+        auto recordDraws = [&](bool useShaderObjects) {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = renderPass;
+            renderPassInfo.framebuffer = swapChainFramebuffers[0];
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = swapChainExtent;
+
+            // The color attachment is cleared on load, in the render pass and in dynamic rendering
+            VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+            renderPassInfo.clearValueCount = 1;
+            renderPassInfo.pClearValues = &clearColor;
+
+            // Shader objects only draw in dynamic rendering, pipelines in the render pass they were built for
+            auto start = std::chrono::steady_clock::now();
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            if (useShaderObjects) {
+                beginDynamicRendering(commandBuffer, 0, clearColor);
+            } else {
+                vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                if (useShaderObjects) {
+                    shaderObjects.bind(commandBuffer, activeShaderObjects, rasterState);
+                    vkCmdSetViewportWithCount(commandBuffer, 1, &viewport);
+                    vkCmdSetScissorWithCount(commandBuffer, 1, &scissor);
+                } else {
+                    // Shader object mode builds no variants, bind one of the pipelines compiled above
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.front());
+                    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                    dynamicRaster.record(commandBuffer, rasterState);
+                }
+                vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            }
+            if (useShaderObjects) {
+                endDynamicRendering(commandBuffer, 0);
+            } else {
+                vkCmdEndRenderPass(commandBuffer);
+            }
+            vkEndCommandBuffer(commandBuffer);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            vkResetCommandBuffer(commandBuffer, 0);
+            return ms;
+        };
+        double pipelineBindMs = recordDraws(false);
+        double shaderObjectBindMs = recordDraws(true);
+
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        for (VkPipeline pipeline : pipelines) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        for (const ShaderObjectSet& set : sets) {
+            shaderObjects.release(set);
+        }
+
+        std::cout << "Shader object benchmark (" << count << " builds, " << count << " draws):\n"
+                  << "\tcompile: pipelines " << pipelineCompileMs << " ms, shader objects " << shaderObjectCompileMs << " ms\n"
+                  << "\tbind:    pipelines " << pipelineBindMs * 1000.0 / count << " us, shader objects "
+                  << shaderObjectBindMs * 1000.0 / count << " us per draw" << std::endl;
+    }
+
+    void createFramebuffers() {
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            VkImageView attachments[] = {swapChainImageViews[i]};
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = attachments;
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create framebuffer!");
+            }
+        }
+    }
+
+    void createCommandPool() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(capabilities);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        // Command buffers are re-recorded every frame, so allow resetting them individually
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool!");
+        }
+
+        // Command buffers for transferQueue and computeQueue must come from a pool of their family.
+        // Uploads are short-lived one-shot command buffers, hence TRANSIENT
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = transferQueueFamily;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create transfer command pool!");
+        }
+
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = computeQueueFamily;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute command pool!");
+        }
+
+        // The swap chain image acquires on presentQueue. Created even for concurrent images, the sharing benchmark switches modes
+        if (!headless && presentQueueFamily != graphicsQueueFamily) {
+            poolInfo.flags = 0;
+            poolInfo.queueFamilyIndex = presentQueueFamily;
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &presentCommandPool) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create present command pool!");
+            }
+        }
+    }
+
+    // The ownership transfer of a swap chain image from the graphics to the present family. The release and the acquire
+    // barrier must describe the same transfer. The render pass already left the image in PRESENT_SRC, so no layout changes
+    VkImageMemoryBarrier ownershipTransferBarrier(uint32_t imageIndex) {
+        VkImageMemoryBarrier barrier = colorImageBarrier(imageIndex, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        barrier.srcQueueFamilyIndex = graphicsQueueFamily;
+        barrier.dstQueueFamilyIndex = presentQueueFamily;
+        return barrier;
+    }
+
+    // The whole color image of a swap chain (or offscreen) image, no ownership transfer. Access masks are left to the caller
+    VkImageMemoryBarrier colorImageBarrier(uint32_t imageIndex, VkImageLayout oldLayout, VkImageLayout newLayout) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[imageIndex];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        return barrier;
+    }
+
+    /*
+    Shader objects can't be used inside a render pass, their draws go between vkCmdBeginRendering and vkCmdEndRendering.
+    Without a render pass nothing changes the image layout, these two barriers do what renderPass does implicitly (see createRenderPass):
+    # Before: UNDEFINED (the old contents are cleared anyway) to COLOR_ATTACHMENT_OPTIMAL, waiting at COLOR_ATTACHMENT_OUTPUT
+      where the image-available semaphore is waited on, like the dependency from VK_SUBPASS_EXTERNAL.
+    # After: COLOR_ATTACHMENT_OPTIMAL to the render pass's finalLayout (PRESENT_SRC, or TRANSFER_SRC for the headless readback),
+      with the color writes made available like its releaseDependency, so the present-family release barrier still follows it.
+    */
+    void beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VkClearValue& clearColor) {
+        VkImageMemoryBarrier toAttachment = colorImageBarrier(imageIndex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        toAttachment.srcAccessMask = 0;
+        toAttachment.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &toAttachment);
+
+        VkRenderingAttachmentInfo colorAttachment{};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        colorAttachment.imageView = swapChainImageViews[imageIndex];
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.clearValue = clearColor;
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea.offset = {0, 0};
+        renderingInfo.renderArea.extent = swapChainExtent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+        vkCmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+    void endDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        vkCmdEndRendering(commandBuffer);
+
+        VkImageLayout finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        VkImageMemoryBarrier toFinal = colorImageBarrier(imageIndex, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, finalLayout);
+        toFinal.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        toFinal.dstAccessMask = 0;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &toFinal);
+    }
+
+    // One acquire command buffer and semaphore per swap chain image. The acquire never changes, so it is recorded once
+    void createOwnershipTransferCommands() {
+        if (!swapChainOwnershipTransfer) {
+            return;
+        }
+
+        presentAcquireCommandBuffers.resize(swapChainImages.size());
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = presentCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(presentAcquireCommandBuffers.size());
+        if (vkAllocateCommandBuffers(device, &allocInfo, presentAcquireCommandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate present command buffers!");
+        }
+
+        for (uint32_t i = 0; i < presentAcquireCommandBuffers.size(); i++) {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            // Nothing waits for the acquire to finish on the CPU, so a resubmission may overlap the previous one
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+            if (vkBeginCommandBuffer(presentAcquireCommandBuffers[i], &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to begin recording present command buffer!");
+            }
+
+            // The access masks of an acquire are ignored on the releasing side and presentation needs none.
+            // ALL_COMMANDS chains it to the render-finished semaphore wait
+            VkImageMemoryBarrier acquire = ownershipTransferBarrier(i);
+            vkCmdPipelineBarrier(presentAcquireCommandBuffers[i], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &acquire);
+
+            if (vkEndCommandBuffer(presentAcquireCommandBuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to record present command buffer!");
+            }
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        presentAcquiredSemaphores.resize(swapChainImages.size());
+        for (auto& semaphore : presentAcquiredSemaphores) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create present acquired semaphore!");
+            }
+        }
+    }
+
+    void destroyOwnershipTransferCommands() {
+        if (!presentAcquireCommandBuffers.empty()) {
+            vkFreeCommandBuffers(device, presentCommandPool, static_cast<uint32_t>(presentAcquireCommandBuffers.size()),
+                                 presentAcquireCommandBuffers.data());
+            presentAcquireCommandBuffers.clear();
+        }
+        for (auto semaphore : presentAcquiredSemaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        presentAcquiredSemaphores.clear();
+    }
+
+    void markSwapChainStale() {
+        if (!swapChainStale) {
+            swapChainStale = true;
+            lastResize = std::chrono::steady_clock::now();
+        }
+    }
+
+    /*
+    Creates a new swap chain and everything that depends on it, and retires the current ones (see RetiredSwapChain).
+    # The render pass and the pipelines stay: the surface format never changes and viewport and scissor are dynamic.
+    # Only this thread submits, so nothing can be recorded against the old framebuffers after this returns.
+    */
+    void recreateSwapChain() {
+        PROFILE_ZONE("recreate swap chain");
+        if (windowMinimized()) {
+            swapChainStale = true; // mainLoop waits for the window to come back, then this runs again
+            return;
+        }
+
+        RetiredSwapChain retired;
+        retired.swapChain = swapChain;
+        retired.imageViews = std::move(swapChainImageViews);
+        retired.framebuffers = std::move(swapChainFramebuffers);
+        retired.renderFinishedSemaphores = std::move(renderFinishedSemaphores);
+        retired.presentAcquireCommandBuffers = std::move(presentAcquireCommandBuffers);
+        retired.presentAcquiredSemaphores = std::move(presentAcquiredSemaphores);
+        retired.retiredAt = retirePoint();
+        retired.retiredAtFrame = frameNumber;
+        swapChainImageViews.clear();
+        swapChainFramebuffers.clear();
+        renderFinishedSemaphores.clear();
+        presentAcquireCommandBuffers.clear();
+        presentAcquiredSemaphores.clear();
+
+        try {
+            createSwapChain();
+        } catch (...) {
+            // The old swap chain is retired even when the new one failed, it can't be used anymore
+            retiredSwapChains.push_back(std::move(retired));
+            swapChain = VK_NULL_HANDLE;
+            throw;
+        }
+        retiredSwapChains.push_back(std::move(retired));
+        swapChainStale = false;
+        swapChainOutOfDate = false;
+        swapChainRecreations++;
+        createImageViews();
+        createFramebuffers();
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        renderFinishedSemaphores.resize(swapChainImages.size());
+        for (auto& semaphore : renderFinishedSemaphores) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create render finished semaphore!");
+            }
+        }
+        createOwnershipTransferCommands();
+    }
+
+    void destroySwapChainResources(RetiredSwapChain& retired) {
+        if (!retired.presentAcquireCommandBuffers.empty()) {
+            vkFreeCommandBuffers(device, presentCommandPool, static_cast<uint32_t>(retired.presentAcquireCommandBuffers.size()),
+                                 retired.presentAcquireCommandBuffers.data());
+        }
+        for (auto semaphore : retired.presentAcquiredSemaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        for (auto semaphore : retired.renderFinishedSemaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        for (auto framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        for (auto imageView : retired.imageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+    }
+
+    /*
+    Renders frameCount frames with concurrent swap chain images, then with exclusive images and ownership transfers.
+    # Only meaningful when graphics and present are separate families, VULK_PRESENT_FAMILY can force that.
+    # A FIFO swap chain caps both at the refresh rate, the difference shows with MAILBOX (or a GPU bound frame).
+    # The configured mode is restored afterwards.
+    */
+    void benchmarkSwapChainSharing(uint32_t frameCount) {
+        using clock = std::chrono::steady_clock;
+
+        if (presentQueueFamily == graphicsQueueFamily) {
+            std::cout << "\n\tSwap chain sharing benchmark skipped: family " << graphicsQueueFamily
+                      << " does graphics and present (VULK_PRESENT_FAMILY picks another one)" << std::endl;
+            return;
+        }
+
+        bool configured = concurrentSwapChainSharing;
+        double msPerFrame[2] = {};
+        for (int exclusive = 0; exclusive < 2; exclusive++) {
+            concurrentSwapChainSharing = exclusive == 0;
+            recreateSwapChain();
+
+            // A few frames first, so the first acquires and lazy driver work don't count
+            for (uint32_t i = 0; i < maxFramesInFlight + 2; i++) {
+                drawFrame();
+            }
+            vkDeviceWaitIdle(device);
+
+            auto start = clock::now();
+            for (uint32_t i = 0; i < frameCount; i++) {
+                glfwPollEvents();
+                drawFrame();
+            }
+            vkDeviceWaitIdle(device);
+            msPerFrame[exclusive] = std::chrono::duration<double, std::milli>(clock::now() - start).count() / frameCount;
+        }
+
+        concurrentSwapChainSharing = configured;
+        recreateSwapChain();
+
+        std::cout << "\n\tSwap chain sharing, " << frameCount << " frames " << swapChainExtent.width << "x" << swapChainExtent.height << ":"
+                  << "\n\t  concurrent:                    " << msPerFrame[0] << " ms/frame"
+                  << "\n\t  exclusive + ownership transfer: " << msPerFrame[1] << " ms/frame" << std::endl;
+    }
+
+    void createCommandBuffers() {
+        frames.resize(maxFramesInFlight);
+
+        std::vector<VkCommandBuffer> commandBuffers(maxFramesInFlight);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = maxFramesInFlight;
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+
+        for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+            frames[i].commandBuffer = commandBuffers[i];
+        }
+
+        std::cout << "\tRendering with " << maxFramesInFlight << " frames in flight" << std::endl;
+    }
+
+    void createSyncObjects() {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        // Fences start signaled so the very first wait in drawFrame doesn't block forever.
+        // With timeline semaphores there are none, a frame slot that never submitted waits for value 0, which is always reached
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (auto& frame : frames) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+                (!timelineSync && vkCreateFence(device, &fenceInfo, nullptr, &frame.inFlightFence) != VK_SUCCESS)) {
+                throw std::runtime_error("Failed to create frame synchronization objects!");
+            }
+        }
+
+        renderFinishedSemaphores.resize(swapChainImages.size());
+        for (auto& semaphore : renderFinishedSemaphores) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create render finished semaphore!");
+            }
+        }
+    }
+
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        PROFILE_ZONE("record commands");
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // re-recorded every frame
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording command buffer!");
+        }
+
+        // Always called right after this frame's fence wait, so the timestamps of its last use are ready to read
+        gpuProfiler.beginFrame(commandBuffer, currentFrame);
+        uint32_t passZone = gpuProfiler.beginZone(commandBuffer, "main render pass");
+
+        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+
+        if (shaderObjectsEnabled) {
+            beginDynamicRendering(commandBuffer, imageIndex, clearColor);
+        } else {
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = renderPass;
+            renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = swapChainExtent;
+            renderPassInfo.clearValueCount = 1;
+            renderPassInfo.pClearValues = &clearColor;
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(swapChainExtent.width);
+        viewport.height = static_cast<float>(swapChainExtent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = swapChainExtent;
+
+        if (shaderObjectsEnabled) {
+            // No pipeline holds any state, the shader objects need the WithCount variants of viewport and scissor
+            shaderObjects.bind(commandBuffer, activeShaderObjects, rasterState);
+            vkCmdSetViewportWithCount(commandBuffer, 1, &viewport);
+            vkCmdSetScissorWithCount(commandBuffer, 1, &scissor);
+        } else {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+            // Whatever raster state the pipeline left dynamic. A no-op without the extended dynamic state mode
+            dynamicRaster.record(commandBuffer, rasterState);
+        }
+
+        // 3 vertices, 1 instance, the positions come from gl_VertexIndex in the vertex shader
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+        if (shaderObjectsEnabled) {
+            endDynamicRendering(commandBuffer, imageIndex);
+        } else {
+            vkCmdEndRenderPass(commandBuffer);
+        }
+
+        if (swapChainOwnershipTransfer) {
+            // Release the image to the present family, the acquire is recorded in createOwnershipTransferCommands
+            VkImageMemoryBarrier release = ownershipTransferBarrier(imageIndex);
+            release.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &release);
+        }
+        gpuProfiler.endZone(commandBuffer, passZone);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer!");
+        }
+    }
+
+    ShaderModuleRef createShaderModule(std::shared_ptr<const SpirvBlob> code) {
         /*
         # Creating a shader module is simple, we only need to specify a pointer to the buffer with the
           bytecode and the length of it. This info is specified in a VkShaderModuleCreateInfo struct.
-        # The one catch is that the size of the bytecode is specifed in bytes but the byecode pointer is a
-          uint32_t pointer rather than a char pointer. So we perform a reinterpret cast
-        # When doing cast like we we gotta make sure to ensure the data satisfies alignment requiremwnrs of uint32_t.
-        # The data stored in std::vector by default ensures that the data satisfies with the worst case alignment requirements
+        # The size of the bytecode is specified in bytes but the bytecode pointer is a uint32_t pointer.
+          SpirvBlob already hands out words straight from the page-aligned mapping, so no cast or copy is needed.
+        # Modules go through moduleCache: bytecode we've already seen returns the existing module,
+          and with VK_EXT_shader_module_identifier creation is deferred until a pipeline build actually needs it.
         */
-       VkShaderModuleCreateInfo createInfo{};
-       createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-       createInfo.codeSize = code.size();
-       createInfo.pCode = reinterpret_cast<const uint32_t*> (code.data());
-
-       VkShaderModule shaderModule;
-       if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create shader module!");
-       }
-
-       return shaderModule;
+       return moduleCache.acquire(std::move(code));
     }
 };
 
@@ -0,0 +1,146 @@
+#include "DeviceCapabilities.h"
+#include "DeviceSelection.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+Ranking and VULK_DEVICE selection of physical devices, on hand-made capability snapshots.
+# Nothing here talks to a driver, describePhysicalDevice only reads the snapshot it is given.
+# A wrong pick is the expensive mistake: a discrete GPU has to win over an integrated one no matter what else they report.
+*/
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// A 1.3 device of this type with one device-local heap and one graphics family. uuidSeed fills deviceUUID with seed, seed+1, ...
+static DeviceCapabilities makeDevice(VkPhysicalDeviceType type, uint64_t heapGiB, uint8_t uuidSeed) {
+    DeviceCapabilities capabilities;
+    capabilities.properties.apiVersion = VK_API_VERSION_1_3;
+    capabilities.properties.deviceType = type;
+    std::strncpy(capabilities.properties.deviceName, "test device", sizeof(capabilities.properties.deviceName) - 1);
+
+    capabilities.memory.memoryHeapCount = 1;
+    capabilities.memory.memoryHeaps[0].size = heapGiB << 30;
+    capabilities.memory.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+
+    VkQueueFamilyProperties graphics{};
+    graphics.queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+    graphics.queueCount = 1;
+    capabilities.queueFamilies.push_back(graphics);
+
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+        capabilities.deviceUUID[i] = static_cast<uint8_t>(uuidSeed + i);
+    }
+    return capabilities;
+}
+
+static void testDeviceType() {
+    // Everything but the type favours the integrated GPU
+    DeviceCapabilities integrated = makeDevice(VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, 256, 0x10);
+    VkQueueFamilyProperties transfer{};
+    transfer.queueFlags = VK_QUEUE_TRANSFER_BIT;
+    transfer.queueCount = 1;
+    VkQueueFamilyProperties compute{};
+    compute.queueFlags = VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+    compute.queueCount = 1;
+    integrated.queueFamilies.push_back(transfer);
+    integrated.queueFamilies.push_back(compute);
+    integrated.extensions = {VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, VK_EXT_SHADER_OBJECT_EXTENSION_NAME};
+    integrated.properties.limits.maxImageDimension2D = 32768;
+    integrated.properties.limits.maxComputeWorkGroupInvocations = 2048;
+
+    DeviceCapabilities discrete = makeDevice(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 1, 0x20);
+
+    PhysicalDeviceCandidate integratedCandidate = describePhysicalDevice(integrated, 0);
+    PhysicalDeviceCandidate discreteCandidate = describePhysicalDevice(discrete, 1);
+    check(integratedCandidate.deviceLocalBytes == 256ull << 30, "the device-local heap is picked up");
+    check(integratedCandidate.dedicatedTransferQueue && integratedCandidate.dedicatedComputeQueue, "dedicated queues are picked up");
+    check(integratedCandidate.perfExtensions.size() == 3, "listed and promoted perf extensions are counted");
+    check(discreteCandidate.score > integratedCandidate.score, "a discrete GPU outscores an integrated one with a far larger heap");
+
+    DeviceCapabilities cpu = makeDevice(VK_PHYSICAL_DEVICE_TYPE_CPU, 512, 0x30);
+    check(describePhysicalDevice(cpu, 2).score < describePhysicalDevice(makeDevice(VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU, 1, 0x40), 3).score,
+          "a CPU device ranks below a virtual GPU");
+
+    std::vector<PhysicalDeviceCandidate> candidates = {integratedCandidate, discreteCandidate};
+    for (auto& candidate : candidates) {
+        candidate.suitable = true;
+    }
+    rankPhysicalDevices(candidates);
+    check(candidates[0].index == 1, "ranking puts the discrete GPU first");
+}
+
+static void testUnsuitableLast() {
+    std::vector<PhysicalDeviceCandidate> candidates;
+    const VkPhysicalDeviceType types[] = {VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, VK_PHYSICAL_DEVICE_TYPE_CPU,
+                                          VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU};
+    for (uint32_t i = 0; i < 4; i++) {
+        candidates.push_back(describePhysicalDevice(makeDevice(types[i], 8, static_cast<uint8_t>(i * 16)), i));
+    }
+    candidates[0].suitable = false; // the best scoring device, e.g. without a present queue for our surface
+    candidates[1].suitable = true;
+    candidates[2].suitable = true;
+    candidates[3].suitable = true;
+
+    rankPhysicalDevices(candidates);
+    check(candidates[0].index == 3, "the suitable discrete GPU comes first");
+    check(candidates[1].index == 2, "then the integrated GPU");
+    check(candidates[2].index == 1, "then the CPU device");
+    check(candidates[3].index == 0 && !candidates[3].suitable, "an unsuitable device sorts last whatever its score");
+}
+
+// The selector's match, -1 when it selects nothing, -2 when it throws
+static int selected(const std::vector<PhysicalDeviceCandidate>& candidates, const std::string& selector) {
+    try {
+        const PhysicalDeviceCandidate* candidate = findRequestedDevice(candidates, selector);
+        return candidate == nullptr ? -1 : static_cast<int>(candidate->index);
+    } catch (const std::runtime_error&) {
+        return -2;
+    }
+}
+
+static void testSelectors() {
+    std::vector<PhysicalDeviceCandidate> candidates = {
+        describePhysicalDevice(makeDevice(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, 0xA0), 0),
+        describePhysicalDevice(makeDevice(VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, 8, 0xB0), 1),
+    };
+    rankPhysicalDevices(candidates); // selectors go by enumeration index, not by rank
+
+    const std::string uuid = "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf";
+    check(candidates[1].uuid == uuid, "the UUID is lowercase hex of deviceUUID");
+
+    check(selected(candidates, "") == -1, "an empty selector selects nothing");
+    check(selected(candidates, "0") == 0, "index 0 selects the first enumerated device");
+    check(selected(candidates, "1") == 1, "index 1 selects the second enumerated device");
+    check(selected(candidates, "7") == -2, "an index past the devices throws");
+    check(selected(candidates, uuid) == 1, "a plain UUID selects its device");
+    check(selected(candidates, "B0B1B2B3-B4B5-B6B7-B8B9-BABBBCBDBEBF") == 1, "an uppercase dashed UUID selects its device");
+    check(selected(candidates, "b0B1b2B3-b4b5-B6B7-b8b9-BaBbBcBdBeBf") == 1, "a mixed-case dashed UUID selects its device");
+    check(selected(candidates, "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf") == 0, "the other UUID selects the other device");
+    check(selected(candidates, "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf") == -2, "a UUID of no device throws");
+    check(selected(candidates, "b0b1b2b3") == -2, "a UUID prefix doesn't match");
+}
+
+int main() {
+    testDeviceType();
+    testUnsuitableLast();
+    testSelectors();
+
+    if (failures != 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "DeviceSelection: all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "SpirvBlob.h"
+#include "SpirvReflect.h"
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+Reflection of the shipped shaders and of modules that are cut short or lie about their sizes.
+# A broken module must end in std::runtime_error, never in a read past the words or a huge allocation.
+# Run under AddressSanitizer (-fsanitize=address) to also catch reads that happen to land in valid memory.
+*/
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Header plus instructions, the bound is patched in by the caller when it matters
+static std::vector<uint32_t> module(const std::vector<std::vector<uint32_t>>& instructions, uint32_t bound = 7) {
+    std::vector<uint32_t> words = {SpirvBlob::MAGIC, 0x00010000, 0, bound, 0};
+    for (const auto& instruction : instructions) {
+        words.insert(words.end(), instruction.begin(), instruction.end());
+    }
+    return words;
+}
+
+// opcode and operands, with the word count in the high half of the first word
+static std::vector<uint32_t> op(uint32_t opcode, const std::vector<uint32_t>& operands = {}) {
+    std::vector<uint32_t> words = {(static_cast<uint32_t>(operands.size() + 1) << 16) | opcode};
+    words.insert(words.end(), operands.begin(), operands.end());
+    return words;
+}
+
+// Reflects words, true when it succeeded, false when it threw std::runtime_error. Anything else is a failure
+static bool reflects(const std::vector<uint32_t>& words, const std::string& what) {
+    try {
+        reflectSpirv(words.data(), words.size());
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    } catch (const std::exception& e) {
+        check(false, what + " threw " + e.what() + " instead of std::runtime_error");
+        return false;
+    }
+}
+
+static std::vector<uint32_t> load(const std::string& name) {
+    SpirvBlob blob(std::string(VULK_TEST_SHADER_DIR) + "/" + name);
+    return std::vector<uint32_t>(blob.words(), blob.words() + blob.wordCount());
+}
+
+static void testShippedShaders() {
+    std::vector<uint32_t> vert = load("vert.spv");
+    ShaderReflection vertReflection = reflectSpirv(vert.data(), vert.size());
+    check(vertReflection.entryPoints.size() == 1, "vert.spv has one entry point");
+    check(vertReflection.stages == VK_SHADER_STAGE_VERTEX_BIT, "vert.spv is a vertex shader");
+
+    std::vector<uint32_t> frag = load("frag.spv");
+    ShaderReflection fragReflection = reflectSpirv(frag.data(), frag.size());
+    check(fragReflection.entryPoints.size() == 1, "frag.spv has one entry point");
+    check(fragReflection.stages == VK_SHADER_STAGE_FRAGMENT_BIT, "frag.spv is a fragment shader");
+    check(!fragReflection.entryPoints.empty() && fragReflection.entryPoints[0].name == "main", "frag.spv entry point is main");
+}
+
+// Every prefix of a real module, most of them end inside an instruction
+static void testTruncated(const std::string& name) {
+    std::vector<uint32_t> words = load(name);
+    for (size_t length = 0; length < words.size(); length++) {
+        std::vector<uint32_t> prefix(words.begin(), words.begin() + length);
+        reflects(prefix, name + " cut to " + std::to_string(length) + " words");
+    }
+}
+
+// Every word of a real module replaced by values that make lengths, ids and indices wrap or overflow
+static void testCorrupted(const std::string& name) {
+    std::vector<uint32_t> words = load(name);
+    for (size_t i = SpirvBlob::HEADER_WORDS; i < words.size(); i++) {
+        for (uint32_t value : {0u, 1u, 0xFFFFu, 0x00010000u | (words[i] & 0xFFFF), 0xFFFFFFFFu}) {
+            std::vector<uint32_t> corrupted = words;
+            corrupted[i] = value;
+            reflects(corrupted, name + " with word " + std::to_string(i) + " = " + std::to_string(value));
+        }
+    }
+}
+
+static void testMalformed() {
+    const uint32_t OpName = 5, OpMemberName = 6, OpEntryPoint = 15, OpTypeInt = 21, OpTypeVector = 23,
+                   OpTypeStruct = 30, OpTypePointer = 32, OpVariable = 59, OpDecorate = 71, OpMemberDecorate = 72;
+    const uint32_t main = 0x6E69616D; // "main" with the terminating nul in the next word
+
+    check(reflects(module({op(OpName, {1, 0})}), "empty name"), "a well-formed OpName reflects");
+
+    check(!reflects(module({}, 0xFFFFFFFF), "huge bound"), "an id bound larger than the module is rejected");
+    check(!reflects(module({op(OpName, {1})}), "OpName without a string"), "OpName without a string is rejected");
+    check(!reflects(module({op(OpMemberName, {1, 0})}), "OpMemberName without a string"), "OpMemberName without a string is rejected");
+    check(!reflects(module({op(OpEntryPoint, {4, 1})}), "OpEntryPoint without a name"), "OpEntryPoint without a name is rejected");
+    check(!reflects(module({op(OpDecorate, {1})}), "OpDecorate without a decoration"), "OpDecorate without a decoration is rejected");
+    check(!reflects(module({op(OpMemberDecorate, {1, 0})}), "OpMemberDecorate without a decoration"),
+          "OpMemberDecorate without a decoration is rejected");
+    check(!reflects(module({op(OpMemberName, {1, 0xFFFFFFF0, 0})}), "huge member index"), "a member index past the module is rejected");
+    check(!reflects(module({op(OpName, {1, main})}), "unterminated name"), "an unterminated string is rejected");
+
+    // An input variable whose vector type lost its component count
+    const uint32_t Location = 30, Input = 1;
+    check(!reflects(module({op(OpEntryPoint, {0, 1, main, 0, 5}),
+                            op(OpDecorate, {5, Location, 0}),
+                            op(OpTypeInt, {2, 32, 0}),
+                            op(OpTypeVector, {3, 2}),
+                            op(OpTypePointer, {4, Input, 3}),
+                            op(OpVariable, {4, 5, Input})}), "short vector type"),
+          "a vector type without a component count is rejected");
+
+    // A vector of itself
+    check(!reflects(module({op(OpEntryPoint, {0, 1, main, 0, 5}),
+                            op(OpDecorate, {5, Location, 0}),
+                            op(OpTypeVector, {3, 3, 4}),
+                            op(OpTypeStruct, {6, 3}),
+                            op(OpTypePointer, {4, Input, 3}),
+                            op(OpVariable, {4, 5, Input})}), "self-referencing type"),
+          "a type that contains itself is rejected");
+
+    // A variable without a storage class, and one whose type isn't a pointer
+    check(!reflects(module({op(OpTypeInt, {2, 32, 0}), op(OpTypePointer, {4, Input, 2}), op(OpVariable, {4, 5})}), "no storage class"),
+          "a variable without a storage class is rejected");
+    check(!reflects(module({op(OpTypeInt, {2, 32, 0}), op(OpVariable, {2, 5, Input})}), "non-pointer variable"),
+          "a variable without a pointer type is rejected");
+}
+
+int main() {
+    testShippedShaders();
+    testTruncated("vert.spv");
+    testTruncated("frag.spv");
+    testCorrupted("vert.spv");
+    testCorrupted("frag.spv");
+    testMalformed();
+
+    if (failures != 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "SpirvReflect: all checks passed" << std::endl;
+    return 0;
+}